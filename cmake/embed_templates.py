@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+#
+# Check the category renderer templates, and embed them minified in a
+# C++ header.
+#
+#   embed_templates.py OUTPUT TEMPLATE...
+#   embed_templates.py --check TEMPLATE...
+#
+# Any malformed template fails the build.
+
+import json
+import os
+import sys
+
+LAYOUTS = {"grid", "carousel", "vertical-journal", "horizontal-list", "organic-grid"}
+CARD_LAYOUTS = {"vertical", "horizontal"}
+CARD_SIZES = {"small", "medium", "large"}
+
+
+def fail(path, message):
+    sys.stderr.write("%s: %s\n" % (path, message))
+    sys.exit(1)
+
+
+def check(path):
+    try:
+        with open(path, "r") as fp:
+            template = json.load(fp)
+    except ValueError as e:
+        fail(path, "invalid JSON: %s" % e)
+
+    if not isinstance(template, dict):
+        fail(path, "a template must be an object")
+    if template.get("schema-version") != 1:
+        fail(path, "schema-version must be 1")
+
+    layout = template.get("template")
+    if not isinstance(layout, dict):
+        fail(path, "missing the template section")
+    if layout.get("category-layout") not in LAYOUTS:
+        fail(path, "unknown category-layout %r" % layout.get("category-layout"))
+    if "card-layout" in layout and layout["card-layout"] not in CARD_LAYOUTS:
+        fail(path, "unknown card-layout %r" % layout["card-layout"])
+    if "card-size" in layout and layout["card-size"] not in CARD_SIZES:
+        fail(path, "unknown card-size %r" % layout["card-size"])
+
+    components = template.get("components")
+    if not isinstance(components, dict) or "title" not in components:
+        fail(path, "components must map at least the title")
+
+    return template
+
+
+def main(argv):
+    if len(argv) > 1 and argv[1] == "--check":
+        for path in argv[2:]:
+            check(path)
+        return
+
+    output = argv[1]
+    lines = [
+        "// Generated by embed_templates.py, do not edit",
+        "",
+        "#ifndef SCOPE_TEMPLATES_H_",
+        "#define SCOPE_TEMPLATES_H_",
+        "",
+        "namespace scope {",
+        "namespace templates {",
+        "",
+    ]
+    for path in argv[2:]:
+        name = os.path.splitext(os.path.basename(path))[0].upper()
+        minified = json.dumps(check(path), separators=(",", ":"))
+        # A JSON string is also a valid C++ string literal
+        lines.append("const char %s[] = %s;" % (name, json.dumps(minified)))
+    lines += [
+        "",
+        "}",
+        "}",
+        "",
+        "#endif // SCOPE_TEMPLATES_H_",
+        "",
+    ]
+
+    with open(output, "w") as fp:
+        fp.write("\n".join(lines))
+
+
+if __name__ == "__main__":
+    main(sys.argv)
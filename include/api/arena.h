@@ -0,0 +1,92 @@
+#ifndef API_ARENA_H_
+#define API_ARENA_H_
+
+#include <boost/utility/string_ref.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace api {
+
+/**
+ * Owns the text of a set of results, so their fields can be views.
+ *
+ * Text is appended to large blocks, or whole documents are adopted, and
+ * neither ever moves: the views stay valid as long as the arena, even when
+ * the arena itself is moved. It can't be copied, as the copies of the views
+ * would still point into the original.
+ */
+class Arena {
+public:
+    Arena();
+
+    Arena(Arena &&other);
+
+    Arena &operator=(Arena &&other);
+
+    Arena(const Arena &) = delete;
+
+    Arena &operator=(const Arena &) = delete;
+
+    /**
+     * Make room for at least size more bytes in a single block, so storing
+     * them doesn't allocate
+     */
+    void reserve(std::size_t size);
+
+    /**
+     * Copy some text in the arena, and return its view
+     */
+    boost::string_ref store(const char *data, std::size_t size);
+
+    boost::string_ref store(boost::string_ref text) {
+        return store(text.data(), text.size());
+    }
+
+    /**
+     * Take the blocks of another arena: the views into it stay valid, and are
+     * now owned by this one
+     */
+    void adopt(Arena &&other);
+
+    /**
+     * Take a whole document without copying it, and return where it now
+     * lives, which may be overwritten until views into it are taken
+     */
+    std::string &adopt(std::string &&document);
+
+    /**
+     * Bytes of text copied in the arena
+     */
+    std::size_t size() const;
+
+    /**
+     * Bytes of the documents adopted
+     */
+    std::size_t adopted() const;
+
+protected:
+    std::vector<std::unique_ptr<char[]>> blocks_;
+
+    /**
+     * Each one on the heap, as moving a short string moves its text too
+     */
+    std::vector<std::unique_ptr<std::string>> documents_;
+
+    /**
+     * Free space at the end of the last block
+     */
+    char *next_;
+
+    std::size_t left_;
+
+    std::size_t size_;
+
+    std::size_t adopted_;
+};
+
+}
+
+#endif // API_ARENA_H_
@@ -0,0 +1,100 @@
+#ifndef API_CIRCUIT_BREAKER_H_
+#define API_CIRCUIT_BREAKER_H_
+
+#include <api/config.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+
+namespace api {
+
+/**
+ * Stops sending requests to an API which keeps failing.
+ *
+ * After Config::breaker_failures failures in a row the breaker opens: the
+ * requests fail right away, instead of each search waiting for its own
+ * timeouts. Once the backoff is over a single probe request is let through
+ * (half-open). If it succeeds the breaker closes again, otherwise the
+ * backoff doubles, up to Config::breaker_max_backoff. The backoff is
+ * jittered, so the scopes of many devices don't probe all at once after an
+ * outage.
+ *
+ * It's thread-safe, and shared by all the requests of the scope.
+ */
+class CircuitBreaker {
+public:
+    typedef std::shared_ptr<CircuitBreaker> Ptr;
+
+    enum class State {
+        closed, open, half_open
+    };
+
+    CircuitBreaker(Config::Ptr config);
+
+    /**
+     * Whether a request may be sent. While half-open only the probe may.
+     */
+    bool allow();
+
+    /**
+     * Report how a request that was allowed ended. Each one must end with
+     * one of these, or a probe would keep the breaker half-open.
+     */
+    void success();
+
+    void failure();
+
+    /**
+     * The request was dropped by us, so it tells nothing about the API
+     */
+    void abandon();
+
+    State state();
+
+    /**
+     * Whether we currently expect the requests to fail
+     */
+    bool tripped();
+
+    /**
+     * Requests which failed fast because the breaker was open
+     */
+    std::uint64_t rejected() const;
+
+protected:
+    typedef std::chrono::steady_clock Clock;
+
+    /**
+     * Open the breaker for the current backoff, with some jitter
+     */
+    void trip();
+
+    Config::Ptr config_;
+
+    std::mutex mutex_;
+
+    State state_;
+
+    unsigned int failures_;
+
+    /**
+     * Whether the probe of the half-open breaker is in flight
+     */
+    bool probing_;
+
+    Clock::duration backoff_;
+
+    Clock::time_point retry_at_;
+
+    std::mt19937 random_;
+
+    std::atomic<std::uint64_t> rejected_;
+};
+
+}
+
+#endif // API_CIRCUIT_BREAKER_H_
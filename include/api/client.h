@@ -1,23 +1,32 @@
 #ifndef API_CLIENT_H_
 #define API_CLIENT_H_
 
+#include <api/arena.h>
+#include <api/circuit_breaker.h>
 #include <api/config.h>
+#include <api/http_pool.h>
 
 #include <atomic>
-#include <deque>
+#include <boost/utility/string_ref.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
 #include <map>
 #include <string>
+#include <vector>
 #include <core/net/http/request.h>
 #include <core/net/uri.h>
 
-#include <QJsonDocument>
-
 namespace api {
 
 /**
  * Provide a nice way to access the HTTP API.
  *
  * We don't want our scope's code to be mixed together with HTTP and JSON handling.
+ *
+ * The text of the results is kept in the arena of their QueryResults or
+ * HomePage, the fields are views into it.
  */
 class Client {
 public:
@@ -25,38 +34,38 @@ public:
      * Abstract
      */
     struct Abstract {
-        std::string summary;
-        std::string textSummary;    // No HTML here
-        std::string source;
-        std::string url;
-        std::string imageUrl;
-        std::string heading;
+        boost::string_ref summary;
+        boost::string_ref textSummary;    // No HTML here
+        boost::string_ref source;
+        boost::string_ref url;
+        boost::string_ref imageUrl;
+        boost::string_ref heading;
     };
 
     /**
      * Answer
      */
     struct Answer {
-        std::string instantAnswer;
-        std::string type;
+        boost::string_ref instantAnswer;
+        boost::string_ref type;
     };
 
     /**
      * Definition
      */
     struct Definition {
-        std::string definition;
-        std::string source;
-        std::string url;
+        boost::string_ref definition;
+        boost::string_ref source;
+        boost::string_ref url;
     };
 
     /**
      * Content it's used by Infobox to load a single information
      */
     struct Content {
-        std::string data_type; // Never found something different from string here, but anyway...
-        std::string value;
-        std::string label;
+        boost::string_ref data_type; // Never found something different from string here, but anyway...
+        boost::string_ref value;
+        boost::string_ref label;
         unsigned int wiki_order;
     };
 
@@ -65,7 +74,7 @@ public:
      * Used by Result
      */
     struct Icon {
-        std::string url;
+        boost::string_ref url;
         unsigned int width;
         unsigned int height;
     };
@@ -74,27 +83,27 @@ public:
      * Single Result from RelatedTopics or Results
      */
     struct Result {
-        std::string result;
-        std::string url;
+        boost::string_ref result;
+        boost::string_ref url;
         Icon icon;
-        std::string text;
+        boost::string_ref text;
     };
 
     /**
      * Infobox: array of informations about an abstract
      */
-    typedef std::deque<Content> Infobox;
+    typedef std::vector<Content> Infobox;
 
     /**
      * RelatedTopics: array of internal links to related topics associated with
      * Abstract
      */
-    typedef std::deque<Result> RelatedTopics;
+    typedef std::vector<Result> RelatedTopics;
 
     /**
      * Results: array of external links associated with Abstract
      */
-    typedef std::deque<Result> Results;
+    typedef std::vector<Result> Results;
 
     /*
      * Query results
@@ -107,9 +116,20 @@ public:
             Infobox infobox;
             RelatedTopics relatedTopics;
             Results results;
-            std::string type;
+            boost::string_ref type;
+
+            /**
+             * Owns the text of all the fields
+             */
+            Arena arena;
+
+            /**
+             * Some request failed or ran out of time, so the results may
+             * miss something. They are shown, but not cached.
+             */
+            bool degraded = false;
 
-            bool isEmpty() {
+            bool isEmpty() const {
                 return abstract.heading.empty() &&
                     answer.type.empty() &&
                     definition.definition.empty() &&
@@ -117,6 +137,60 @@ public:
                     relatedTopics.empty() &&
                     results.empty();
             }
+
+            /**
+             * Take best of both: fill what we are missing with what the
+             * other results have. The text of the other results moves here,
+             * it isn't copied.
+             */
+            void merge(QueryResults &&other);
+
+            /**
+             * The results can only be moved, as their text belongs to the
+             * arena. This copies the text in a new one.
+             */
+            QueryResults copy() const;
+
+            /**
+             * Call f with each text field, which it may replace
+             */
+            template<typename F>
+            void for_each_text(F f) {
+                for_each_text(f, f);
+            }
+
+            /**
+             * Call text with the fields shown as they are, and raw with the
+             * URLs and the HTML of the results
+             */
+            template<typename T, typename R>
+            void for_each_text(T text, R raw) {
+                text(abstract.summary);
+                text(abstract.textSummary);
+                text(abstract.source);
+                raw(abstract.url);
+                raw(abstract.imageUrl);
+                text(abstract.heading);
+                text(answer.instantAnswer);
+                text(answer.type);
+                text(definition.definition);
+                text(definition.source);
+                raw(definition.url);
+                text(type);
+                for (auto &content : infobox) {
+                    text(content.data_type);
+                    text(content.value);
+                    text(content.label);
+                }
+                for (auto *list : { &relatedTopics, &results }) {
+                    for (auto &result : *list) {
+                        raw(result.result);
+                        raw(result.url);
+                        raw(result.icon.url);
+                        text(result.text);
+                    }
+                }
+            }
     };
 
     public: class HomePage {
@@ -124,19 +198,38 @@ public:
             Answer fortune;
             Answer sunrise;
 
-            bool isEmpty() {
+            /**
+             * Owns the text of the answers
+             */
+            Arena arena;
+
+            bool isEmpty() const {
                 return fortune.type.empty() &&
                     sunrise.type.empty();
             }
     };
 
-    Client(Config::Ptr config);
+    /**
+     * Requests go through the shared pool when there is one, otherwise
+     * each request opens its own connection. With a breaker, they fail fast
+     * while the API is down.
+     */
+    Client(Config::Ptr config, HttpPool::Ptr pool = HttpPool::Ptr(),
+           CircuitBreaker::Ptr breaker = CircuitBreaker::Ptr());
 
     virtual ~Client() = default;
+    /**
+     * Called with the results of the ?q= response, while the path-form one
+     * is still in flight. The path-form results are never shown before the
+     * merge, as the ?q= ones take their place.
+     */
+    typedef std::function<void(const QueryResults &)> Partial;
+
     /*
      * Get the result of a query or of the homepage
      */
-    virtual QueryResults queryResults(const std::string &query);
+    virtual QueryResults queryResults(const std::string &query,
+                                      const Partial &partial = Partial());
     virtual HomePage homepageResults(const std::string &query);
 
     /**
@@ -144,17 +237,32 @@ public:
      */
     virtual void cancel();
 
+    /**
+     * Whether #cancel has been called
+     */
+    virtual bool cancelled() const;
+
     virtual Config::Ptr config();
 
 protected:
+    /**
+     * Make a request, and decode the JSON response into results
+     */
     void get(const core::net::Uri::Path &path,
              const core::net::Uri::QueryParameters &parameters,
-             QJsonDocument &root);
+             QueryResults &results);
     /**
-     * Progress callback that allows the query to cancel pending HTTP requests.
+     * Progress callback that allows the query to cancel pending HTTP requests,
+     * and aborts them when they run out of time.
+     *
+     * The transport may call it after the request is given up, even after the
+     * client is gone: it only uses what it's given.
      */
-    core::net::http::Request::Progress::Next progress_report(
-            const core::net::http::Request::Progress& progress);
+    static core::net::http::Request::Progress::Next progress_report(
+            const core::net::http::Request::Progress& progress,
+            const std::atomic<bool> &cancelled,
+            std::chrono::steady_clock::time_point connect_by,
+            std::chrono::steady_clock::time_point deadline);
 
     /**
      * Hang onto the configuration information
@@ -162,9 +270,26 @@ protected:
     Config::Ptr config_;
 
     /**
-     * Thread-safe cancelled flag
+     * Connections shared with the other clients of the scope
+     */
+    HttpPool::Ptr pool_;
+
+    /**
+     * Shared with the other clients of the scope, may be nullptr
+     */
+    CircuitBreaker::Ptr breaker_;
+
+    /**
+     * Thread-safe cancelled flag, shared with the progress callbacks of the
+     * requests
+     */
+    std::shared_ptr<std::atomic<bool>> cancelled_;
+
+    /**
+     * When the results of the current search are due, set before its
+     * requests start
      */
-    std::atomic<bool> cancelled_;
+    std::chrono::steady_clock::time_point deadline_;
 };
 
 }
@@ -1,6 +1,9 @@
 #ifndef API_CONFIG_H_
 #define API_CONFIG_H_
 
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <string>
 
@@ -9,6 +12,22 @@ namespace api {
 struct Config {
     typedef std::shared_ptr<Config> Ptr;
 
+    /*
+     * When a search asks DuckDuckGo again with the path form of the query
+     */
+    enum class SecondFetch {
+        /*
+         * Together with the ?q= form, for the lowest latency
+         */
+        always,
+
+        /*
+         * Only after the ?q= response, when it misses fields expected for
+         * its type. It halves the requests of most searches.
+         */
+        when_incomplete
+    };
+
     /*
      * The root of all API request URLs
      */
@@ -18,6 +37,140 @@ struct Config {
      * The custom HTTP user agent string for this library
      */
     std::string user_agent { "discerning-duck 0.1; (foo)" };
+
+    SecondFetch second_fetch { SecondFetch::always };
+
+    /*
+     * Time budget of a search: once it runs out, the requests still in
+     * flight are aborted and we show what the others brought
+     */
+    std::chrono::milliseconds query_deadline { 800 };
+
+    /*
+     * How long a request waits for the first byte of the response
+     */
+    std::chrono::milliseconds connect_timeout { 500 };
+
+    /*
+     * How long a single request may take as a whole, within the budget of
+     * its search
+     */
+    std::chrono::milliseconds request_timeout { 5000 };
+
+    /*
+     * Maximum number of requests in flight against a single host
+     */
+    unsigned int max_connections_per_host { 4 };
+
+    /*
+     * A request which hasn't answered by this percentile of the recent
+     * latencies of its endpoint is sent again, and the first response wins
+     */
+    double hedge_percentile { 0.95 };
+
+    /*
+     * How many recent latencies of each endpoint are kept, and how many are
+     * needed before hedging
+     */
+    std::size_t hedge_window { 128 };
+
+    std::size_t hedge_min_samples { 20 };
+
+    /*
+     * Maximum share of the requests which may be hedged, so we don't
+     * multiply the load on the API
+     */
+    double hedge_rate { 0.05 };
+
+    /*
+     * Failures in a row after which requests fail fast, instead of waiting
+     * for their timeouts
+     */
+    unsigned int breaker_failures { 5 };
+
+    /*
+     * How long to wait before probing the API again, doubled after each
+     * failed probe
+     */
+    std::chrono::milliseconds breaker_backoff { 1000 };
+
+    std::chrono::milliseconds breaker_max_backoff { 60 * 1000 };
+
+    /*
+     * Maximum number of query results kept in memory
+     */
+    std::size_t cache_size { 256 };
+
+    /*
+     * How long cached query results are served before fetching them again
+     */
+    std::chrono::seconds cache_ttl { 300 };
+
+    /*
+     * How long past cache_ttl cached query results are still shown when they
+     * can't be fetched again
+     */
+    std::chrono::seconds cache_stale_ttl { 60 * 60 };
+
+    /*
+     * Maximum size in bytes of the query results stored on disk
+     */
+    std::uint64_t disk_cache_size { 8 * 1024 * 1024 };
+
+    /*
+     * How long query results stored on disk are served
+     */
+    std::chrono::seconds disk_cache_ttl { 24 * 60 * 60 };
+
+    /*
+     * How often the data of the homepage is fetched again
+     */
+    std::chrono::seconds homepage_refresh { 15 * 60 };
+
+    /*
+     * How soon a failed homepage refresh is tried again
+     */
+    std::chrono::seconds homepage_retry { 30 };
+
+    /*
+     * Queries shorter than this are held back for #debounce before going to
+     * the network, as the user is likely still typing
+     */
+    std::size_t debounce_prefix_length { 3 };
+
+    std::chrono::milliseconds debounce { 150 };
+
+    /*
+     * How many cards of a long list, like the infobox or the related
+     * topics, are pushed on phones and on larger screens. The others are
+     * behind a card which runs the query again in the full department.
+     */
+    std::size_t phone_cards { 6 };
+
+    std::size_t desktop_cards { 12 };
+
+    /*
+     * How many of the first topics of a category or a disambiguation are
+     * fetched in background, as the likely next searches
+     */
+    std::size_t prefetch_topics { 3 };
+
+    /*
+     * Maximum number of prefetches running at the same time, and waiting
+     */
+    unsigned int prefetch_concurrency { 2 };
+
+    std::size_t prefetch_queue { 16 };
+
+    /*
+     * How often a waiting prefetch looks whether the searches are over
+     */
+    std::chrono::milliseconds prefetch_idle { 100 };
+
+    /*
+     * How often the metrics are written to the stats file
+     */
+    std::chrono::seconds stats_interval { 10 };
 };
 
 }
@@ -0,0 +1,38 @@
+#ifndef API_DECODER_H_
+#define API_DECODER_H_
+
+#include <api/client.h>
+
+#include <cstddef>
+#include <string>
+
+namespace api {
+
+/**
+ * Decode the JSON of a DuckDuckGo response straight into the Client structs.
+ *
+ * The document is read in a single pass over the response bytes: the text of
+ * the fields is copied directly in the arena of the results, without building
+ * a tree first, and the subtrees we don't use are skipped.
+ */
+class Decoder {
+public:
+    /**
+     * Decode a response.
+     *
+     * Returns false if it's not valid JSON, and the results are left empty.
+     */
+    static bool decode(const char *data, std::size_t size,
+                       Client::QueryResults &results);
+
+    /**
+     * Decode a response we own, without copying it: the document moves in
+     * the arena of the results, its strings are unescaped over it, and the
+     * fields are views into it.
+     */
+    static bool decode(std::string &&document, Client::QueryResults &results);
+};
+
+}
+
+#endif // API_DECODER_H_
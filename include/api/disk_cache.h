@@ -0,0 +1,157 @@
+#ifndef API_DISK_CACHE_H_
+#define API_DISK_CACHE_H_
+
+#include <api/client.h>
+#include <api/config.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace api {
+
+/**
+ * Persistent store of query results, which survives scope restarts.
+ *
+ * Results are serialized in a compact binary form and appended to a log
+ * file, which is memory-mapped to read them back: a lookup never parses
+ * JSON again. An in-memory index maps the hash of each query to its latest
+ * record. The file grows ahead of the log, so it's seldom mapped again.
+ *
+ * Nothing is touched on disk until the first lookup, so creating it is
+ * cheap. Records older than Config::disk_cache_ttl are dropped when the log
+ * is compacted, which happens when it holds more dead than live records or
+ * grows beyond Config::disk_cache_size. Compaction runs on a thread of its
+ * own, so the searches never wait for it.
+ *
+ * Queries are indexed by their hash: when two of them share one, the first
+ * keeps its place until it expires, and the other isn't stored.
+ */
+class DiskCache {
+public:
+    typedef std::shared_ptr<DiskCache> Ptr;
+
+    DiskCache(Config::Ptr config, const std::string &path);
+
+    virtual ~DiskCache();
+
+    /**
+     * Get the results for a query, or nullptr if they are missing or expired.
+     * Expired results are still good when we can't fetch new ones, until the
+     * log is compacted.
+     */
+    std::shared_ptr<const Client::QueryResults> get(const std::string &query,
+                                                    bool stale = false);
+
+    void put(const std::string &query, const Client::QueryResults &results);
+
+    /**
+     * Bytes taken by the records in the log, the file may be larger
+     */
+    std::uint64_t size();
+
+    /**
+     * Stop compacting, a compaction in progress is dropped
+     */
+    void stop();
+
+protected:
+    /**
+     * Where the latest record of a query is in the log
+     */
+    struct Slot {
+        std::uint64_t offset;
+        std::int64_t stored;
+    };
+
+    virtual std::uint64_t hash(const std::string &query) const;
+
+    bool open();
+
+    void close();
+
+    /**
+     * Make sure the records of the log are mapped
+     */
+    bool map();
+
+    bool remap(std::uint64_t size);
+
+    /**
+     * Grow the file, and its mapping, to hold at least size bytes of log
+     */
+    bool reserve(std::uint64_t size);
+
+    void scan();
+
+    /**
+     * Size of the record at offset, which must be mapped
+     */
+    std::uint64_t size_of(std::uint64_t offset) const;
+
+    /**
+     * Whether the record of a slot is for this query, not just for its hash
+     */
+    bool owns(const Slot &slot, const std::string &query) const;
+
+    bool bloated() const;
+
+    /**
+     * Wake up the compactor, if the log needs it
+     */
+    void schedule();
+
+    void run();
+
+    /**
+     * Called with the lock held, which is released while copying the records
+     */
+    void compact(std::unique_lock<std::mutex> &lock);
+
+    bool expired(std::int64_t stored) const;
+
+    Config::Ptr config_;
+
+    std::string path_;
+
+    std::mutex mutex_;
+
+    /**
+     * The log is opened lazily, and only once
+     */
+    bool opened_;
+
+    int fd_;
+
+    const char *data_;
+
+    /**
+     * Size of the file, which is mapped whole
+     */
+    std::uint64_t mapped_;
+
+    /**
+     * End of the last valid record
+     */
+    std::uint64_t end_;
+
+    std::uint64_t live_;
+
+    std::unordered_map<std::uint64_t, Slot> index_;
+
+    std::thread compactor_;
+
+    std::condition_variable wake_;
+
+    bool compact_;
+
+    bool stopped_;
+};
+
+}
+
+#endif // API_DISK_CACHE_H_
@@ -0,0 +1,63 @@
+#ifndef API_HISTOGRAM_H_
+#define API_HISTOGRAM_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace api {
+
+/**
+ * Lock-free histogram of durations.
+ *
+ * Bucket i counts the durations up to 2^i microseconds, so a few buckets
+ * cover everything from microseconds to minutes. Recording is wait-free, it
+ * can be done from any thread.
+ */
+class Histogram {
+public:
+    static const std::size_t BUCKETS = 32;
+
+    Histogram();
+
+    Histogram(const Histogram &) = delete;
+
+    Histogram &operator=(const Histogram &) = delete;
+
+    void record(std::chrono::microseconds duration);
+
+    std::uint64_t count() const;
+
+    /**
+     * Sum of all the recorded durations
+     */
+    std::chrono::microseconds sum() const;
+
+    /**
+     * Number of durations recorded in a bucket
+     */
+    std::uint64_t bucket(std::size_t i) const;
+
+    /**
+     * Largest duration counted by a bucket
+     */
+    static std::chrono::microseconds upper_bound(std::size_t i);
+
+    /**
+     * Estimate of the q quantile (between 0 and 1): the upper bound of the
+     * bucket where it falls
+     */
+    std::chrono::microseconds percentile(double q) const;
+
+protected:
+    std::atomic<std::uint64_t> buckets_[BUCKETS];
+
+    std::atomic<std::uint64_t> count_;
+
+    std::atomic<std::uint64_t> sum_;
+};
+
+}
+
+#endif // API_HISTOGRAM_H_
@@ -0,0 +1,199 @@
+#ifndef API_HTTP_POOL_H_
+#define API_HTTP_POOL_H_
+
+#include <api/config.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <core/net/http/request.h>
+#include <core/net/http/response.h>
+#include <core/net/uri.h>
+
+namespace core {
+namespace net {
+namespace http {
+class Client;
+}
+}
+}
+
+namespace api {
+
+/**
+ * Long-lived HTTP transport shared by every Client of the scope.
+ *
+ * All the requests go through a single net-cpp client, whose event loop runs
+ * on a worker thread. This way its connection cache keeps the connections to
+ * the API alive between searches, instead of paying DNS, TCP and TLS setup
+ * for each request.
+ *
+ * It's thread-safe: #execute can be called from every query thread.
+ */
+class HttpPool {
+public:
+    typedef std::shared_ptr<HttpPool> Ptr;
+
+    HttpPool(Config::Ptr config);
+
+    ~HttpPool();
+
+    /**
+     * Synchronously make a request through the shared connections.
+     *
+     * Blocks while the host already has Config::max_connections_per_host
+     * requests in flight, but not past the deadline, nor once cancelled is
+     * set and #wake called. Throws a net::Error if the response isn't there
+     * by the deadline.
+     *
+     * The transport may still call progress after we return: it must own
+     * whatever it uses, not refer to the caller.
+     *
+     * Requests to the same endpoint are expected to take alike: when one is
+     * slower than most of the recent ones, it's hedged with a duplicate.
+     * Without an endpoint, requests are never hedged.
+     */
+    core::net::http::Response execute(
+            const core::net::http::Request::Configuration &configuration,
+            const core::net::http::Request::ProgressHandler &progress,
+            std::chrono::steady_clock::time_point deadline =
+                std::chrono::steady_clock::time_point::max(),
+            const std::string &endpoint = std::string(),
+            const std::atomic<bool> *cancelled = nullptr);
+
+    /**
+     * Wake up the requests waiting for a connection, so that the cancelled
+     * ones give up
+     */
+    void wake();
+
+    std::string uri_to_string(const core::net::Uri &uri) const;
+
+    /**
+     * Requests which waited for a connection, as their host already had
+     * Config::max_connections_per_host in flight.
+     *
+     * net-cpp keeps the connections in its curl handles and doesn't report
+     * whether a request reused one: how often the pool runs out of
+     * connections is what we can tell.
+     */
+    std::uint64_t waited() const;
+
+    /**
+     * Requests which have been hedged, and how many of them were answered
+     * first by the duplicate
+     */
+    std::uint64_t hedged() const;
+
+    std::uint64_t hedge_wins() const;
+
+    /**
+     * Stop the event loop, pending requests fail with a net::Error
+     */
+    void stop();
+
+protected:
+    /**
+     * Requests in flight against a single host, and those waiting for one
+     * of them to be over
+     */
+    struct Host {
+        unsigned int active = 0;
+        std::condition_variable available;
+    };
+
+    /**
+     * The outcome of a request, shared with the handlers of its attempts.
+     *
+     * The first response settles it, an error only if no other attempt is
+     * left. #stop settles it too, so that nobody waits on a stopped event
+     * loop.
+     */
+    struct Call {
+        typedef std::shared_ptr<Call> Ptr;
+
+        std::promise<core::net::http::Response> done;
+        std::atomic<bool> settled { false };
+        std::atomic<int> pending { 0 };
+        std::atomic<bool> hedge_won { false };
+    };
+
+    /**
+     * Rolling latencies of the requests to an endpoint
+     */
+    struct Endpoint {
+        std::vector<std::chrono::microseconds> samples;
+        std::size_t next = 0;
+
+        /**
+         * Config::hedge_percentile of #samples
+         */
+        std::chrono::microseconds hedge_after { std::chrono::microseconds::max() };
+    };
+
+    /**
+     * Take a connection to the host, throws a net::Error if the deadline or
+     * the cancellation comes first
+     */
+    void acquire(const std::string &host,
+                 std::chrono::steady_clock::time_point deadline,
+                 const std::atomic<bool> *cancelled);
+
+    /**
+     * Take a connection for a hedge, if both the rate cap and the host allow
+     * it
+     */
+    bool acquire_hedge(const std::string &host);
+
+    std::chrono::microseconds hedge_after(const std::string &endpoint);
+
+    /**
+     * Add a latency to the window of an endpoint.
+     *
+     * A hedged request records both of its attempts: the one that won, and
+     * the time waited on the first one, which is a lower bound of its latency.
+     */
+    void record(const std::string &endpoint, std::chrono::microseconds latency);
+
+    void release(const std::string &host);
+
+    Config::Ptr config_;
+
+    std::shared_ptr<core::net::http::Client> client_;
+
+    std::thread worker_;
+
+    std::mutex mutex_;
+
+    std::map<std::string, Host> hosts_;
+
+    std::map<std::string, Endpoint> endpoints_;
+
+    std::set<Call::Ptr> calls_;
+
+    /**
+     * Hedges we can still send: each request earns Config::hedge_rate of one
+     */
+    double hedge_budget_;
+
+    std::atomic<bool> stopped_;
+
+    std::atomic<std::uint64_t> waited_;
+
+    std::atomic<std::uint64_t> hedged_;
+
+    std::atomic<std::uint64_t> hedge_wins_;
+};
+
+}
+
+#endif // API_HTTP_POOL_H_
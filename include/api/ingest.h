@@ -0,0 +1,56 @@
+#ifndef API_INGEST_H_
+#define API_INGEST_H_
+
+#include <api/arena.h>
+#include <api/client.h>
+
+#include <boost/utility/string_ref.hpp>
+#include <cstddef>
+
+namespace api {
+
+/**
+ * Clean the text of the responses before it's shown: invalid UTF-8 is
+ * replaced by U+FFFD, and the HTML entities DuckDuckGo leaves even without
+ * HTML are decoded in the text which is shown as it is. URLs and markup are
+ * only validated: an entity there belongs to the link, or is decoded once
+ * the text is taken out of the markup.
+ *
+ * Most text needs nothing of this, and it's recognized with a single scan
+ * over the field, 16 bytes at a time with SSE2 where available. Fields which
+ * are already clean are left as they are.
+ */
+class Ingest {
+public:
+    /**
+     * Clean the text fields of the results, and validate their URLs and
+     * markup. The fields which change are rewritten in their arena.
+     */
+    static void clean(Client::QueryResults &results);
+
+    /**
+     * Clean a text: the text itself if it's already clean, otherwise its
+     * cleaned copy, stored in the arena
+     */
+    static boost::string_ref clean(boost::string_ref text, Arena &arena);
+
+    /**
+     * Like clean, but the entities are left as they are
+     */
+    static boost::string_ref validate(boost::string_ref text, Arena &arena);
+
+    /**
+     * Length of the start of a text which is plain ASCII, without entities
+     */
+    static std::size_t plain(boost::string_ref text);
+
+    /**
+     * Encode a code point as UTF-8 into out, which has room for 4 bytes.
+     * Returns the number of bytes.
+     */
+    static std::size_t encode(char *out, unsigned int cp);
+};
+
+}
+
+#endif // API_INGEST_H_
@@ -0,0 +1,66 @@
+#ifndef API_MARKUP_H_
+#define API_MARKUP_H_
+
+#include <boost/utility/string_ref.hpp>
+
+#include <cstddef>
+
+namespace api {
+
+/**
+ * Splits the snippets of HTML found in the responses.
+ *
+ * Each snippet is read in a single pass, and the pieces are views into it.
+ * The scans use SSE2 where available, with a plain loop for the rest.
+ * Malformed snippets give empty pieces, never a view out of the snippet.
+ */
+class Markup {
+public:
+    static const std::size_t npos = boost::string_ref::npos;
+
+    /**
+     * A link followed by some text, like a related topic:
+     *
+     * <a href="https://duckduckgo.com/Ferrara">Ferrara</a> - A city in Italy
+     */
+    struct Anchor {
+        boost::string_ref title;
+        boost::string_ref text;
+    };
+
+    /**
+     * Split a link from the text after it. Without an opening tag, it's all
+     * text; without a closing tag, it's all title.
+     */
+    static Anchor anchor(boost::string_ref html);
+
+    /**
+     * The sunrise answer: where, and the times of sunrise and sunset, still
+     * in their markup
+     *
+     * <div ...><span>Sunrise and sunset @</span>Ferrara, Italy</div>
+     * <span class='suninfo--risebox'>...</span>
+     */
+    struct Sunrise {
+        boost::string_ref location;
+        boost::string_ref times;
+    };
+
+    static Sunrise sunrise(boost::string_ref html);
+
+    /**
+     * Position of the first c at or after from, or npos
+     */
+    static std::size_t find(boost::string_ref text, char c,
+                            std::size_t from = 0);
+
+    /**
+     * Position of the first needle at or after from, or npos
+     */
+    static std::size_t find(boost::string_ref text, boost::string_ref needle,
+                            std::size_t from = 0);
+};
+
+}
+
+#endif // API_MARKUP_H_
@@ -0,0 +1,141 @@
+#ifndef API_METRICS_H_
+#define API_METRICS_H_
+
+#include <api/histogram.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+namespace api {
+
+/**
+ * Where the time of the searches goes, and how often things happen.
+ *
+ * There is a single set of metrics for the whole scope. They are only
+ * atomics and lock-free histograms, so updating them from the search threads
+ * costs close to nothing.
+ */
+struct Metrics {
+    typedef std::atomic<std::uint64_t> Counter;
+
+    static Metrics &instance();
+
+    /**
+     * Phases of a request: from sending it to the first byte of the
+     * response, then to its last byte, and the decoding of the JSON.
+     * net-cpp doesn't report when the connection is up, so the connection
+     * setup is part of the time to first byte.
+     */
+    Histogram first_byte;
+
+    Histogram transfer;
+
+    Histogram decode;
+
+    /**
+     * Phases of a search: the merge of the responses, the rendering of each
+     * section, and handing each card to the shell
+     */
+    Histogram merge;
+
+    Histogram render;
+
+    Histogram push;
+
+    /**
+     * From the start of a search to its first card, and to its last
+     */
+    Histogram first_card;
+
+    Histogram last_card;
+
+    Counter requests { 0 };
+
+    /**
+     * Requests which failed in the transport, or which DuckDuckGo refused
+     */
+    Counter request_errors { 0 };
+
+    Counter http_errors { 0 };
+
+    /**
+     * See Config::second_fetch
+     */
+    Counter second_fetch_sent { 0 };
+
+    Counter second_fetch_skipped { 0 };
+
+    /**
+     * Searches cancelled before the second request was due
+     */
+    Counter second_fetch_cancelled { 0 };
+
+    /**
+     * Searches which had to make do with part of the responses
+     */
+    Counter degraded { 0 };
+
+    Counter searches { 0 };
+
+    Counter cancellations { 0 };
+
+    Counter errors { 0 };
+
+    /**
+     * Where the results of the searches came from
+     */
+    Counter memory_cache_hits { 0 };
+
+    Counter disk_cache_hits { 0 };
+
+    Counter stale_cache_hits { 0 };
+
+    Counter cache_misses { 0 };
+
+    /**
+     * Searches fetched in background, and those aborted for a search
+     */
+    Counter prefetches { 0 };
+
+    Counter prefetch_aborts { 0 };
+
+    /**
+     * Write the metrics in the Prometheus text format
+     */
+    void write(std::ostream &out) const;
+
+    /**
+     * Record the time spent in a block
+     */
+    class Timer {
+    public:
+        Timer(Histogram &histogram) :
+            histogram_(histogram), started_(std::chrono::steady_clock::now()) {
+        }
+
+        ~Timer() {
+            histogram_.record(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - started_));
+        }
+
+    protected:
+        Histogram &histogram_;
+
+        std::chrono::steady_clock::time_point started_;
+    };
+
+    /**
+     * Write a single sample in the Prometheus text format
+     */
+    static void write(std::ostream &out, const char *name, const char *help,
+                      const char *type, std::uint64_t value);
+
+    static void write(std::ostream &out, const char *name, const char *help,
+                      const Histogram &histogram);
+};
+
+}
+
+#endif // API_METRICS_H_
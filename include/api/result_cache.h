@@ -0,0 +1,71 @@
+#ifndef API_RESULT_CACHE_H_
+#define API_RESULT_CACHE_H_
+
+#include <api/client.h>
+#include <api/config.h>
+
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace api {
+
+/**
+ * Size-bounded LRU of parsed query results, shared by all the queries.
+ *
+ * Entries older than Config::cache_ttl are only returned when stale results
+ * are asked for, and are dropped once Config::cache_stale_ttl is over too.
+ * The least recently used entry is evicted once Config::cache_size is
+ * reached.
+ * It's thread-safe, so it can be used from the concurrent search threads.
+ */
+class ResultCache {
+public:
+    typedef std::shared_ptr<ResultCache> Ptr;
+
+    /**
+     * Results are immutable once cached, so they are shared instead of copied
+     */
+    typedef std::shared_ptr<const Client::QueryResults> Entry;
+
+    ResultCache(Config::Ptr config);
+
+    /**
+     * Get the results for a query, or nullptr if they are missing or expired.
+     * Expired results are still good when we can't fetch new ones.
+     */
+    Entry get(const std::string &query, bool stale = false);
+
+    void put(const std::string &query, Entry results);
+
+    std::size_t size();
+
+    void clear();
+
+protected:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Item {
+        std::string query;
+        Entry results;
+        Clock::time_point stored;
+    };
+
+    Config::Ptr config_;
+
+    std::mutex mutex_;
+
+    /**
+     * Most recently used first
+     */
+    std::list<Item> items_;
+
+    std::unordered_map<std::string, std::list<Item>::iterator> index_;
+};
+
+}
+
+#endif // API_RESULT_CACHE_H_
@@ -0,0 +1,156 @@
+#ifndef API_SINGLE_FLIGHT_H_
+#define API_SINGLE_FLIGHT_H_
+
+#include <api/client.h>
+#include <api/config.h>
+#include <api/http_pool.h>
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace api {
+
+/**
+ * Coalesces identical concurrent searches into a single fetch.
+ *
+ * The first caller for a query starts the fetch in background, with its own
+ * Client. The callers asking for the same normalized query while it's in
+ * flight wait for the same results, instead of sending their own requests.
+ *
+ * Each caller can stop waiting on its own: the fetch is aborted only when
+ * nobody is waiting for it anymore.
+ */
+class SingleFlight: public std::enable_shared_from_this<SingleFlight> {
+public:
+    typedef std::shared_ptr<SingleFlight> Ptr;
+
+    typedef std::shared_ptr<const Client::QueryResults> Results;
+
+    /**
+     * Get the results of a query, using the client of the flight, and
+     * reporting the results of the first response to partial
+     */
+    typedef std::function<Results(Client &client,
+                                  const Client::Partial &partial)> Fetch;
+
+protected:
+    struct Flight {
+        std::condition_variable changed;
+        bool done = false;
+        Results partial;
+        Results results;
+        std::exception_ptr error;
+        unsigned int waiters = 0;
+        std::shared_ptr<Client> client;
+    };
+
+public:
+    /**
+     * A caller waiting for a flight
+     */
+    class Waiter {
+    public:
+        typedef std::shared_ptr<Waiter> Ptr;
+
+        Waiter(SingleFlight::Ptr owner, const std::string &key,
+               std::shared_ptr<Flight> flight);
+
+        ~Waiter();
+
+        /**
+         * Block until the results arrive.
+         *
+         * While waiting, partial is called with the results of the first
+         * response, if they arrive before the others.
+         *
+         * Returns nullptr if #cancel has been called, and rethrows what the
+         * fetch threw.
+         */
+        Results wait(const Client::Partial &partial = Client::Partial());
+
+        /**
+         * Stop waiting, this method can be called from a different thread
+         */
+        void cancel();
+
+    protected:
+        void leave();
+
+        SingleFlight::Ptr owner_;
+
+        std::string key_;
+
+        std::shared_ptr<Flight> flight_;
+
+        bool cancelled_;
+    };
+
+    SingleFlight(Config::Ptr config, HttpPool::Ptr pool,
+                 CircuitBreaker::Ptr breaker = CircuitBreaker::Ptr());
+
+    ~SingleFlight();
+
+    /**
+     * Wait for the results of a query, starting a fetch if nobody is already
+     * getting them
+     */
+    Waiter::Ptr join(const std::string &query, const Fetch &fetch);
+
+    /**
+     * Abort the flights and wait for their threads: the fetches run code of
+     * the scope, which mustn't be unloaded under them. The flights joined
+     * afterwards end right away, without results.
+     */
+    void stop();
+
+    /**
+     * Queries differing only by case or spacing share the same flight, and
+     * their results are cached under this key
+     */
+    static std::string normalize(const std::string &query);
+
+protected:
+    void run(const std::string &key, std::shared_ptr<Flight> flight,
+             Fetch fetch);
+
+    /**
+     * Join the threads of the flights which are over
+     */
+    void reap();
+
+    Config::Ptr config_;
+
+    HttpPool::Ptr pool_;
+
+    CircuitBreaker::Ptr breaker_;
+
+    /**
+     * Guards the flights and all their state
+     */
+    std::mutex mutex_;
+
+    std::map<std::string, std::shared_ptr<Flight>> flights_;
+
+    /**
+     * The thread running each flight, until it's joined
+     */
+    struct Runner {
+        std::shared_ptr<Flight> flight;
+        std::thread thread;
+    };
+
+    std::list<Runner> runners_;
+
+    bool stopped_;
+};
+
+}
+
+#endif // API_SINGLE_FLIGHT_H_
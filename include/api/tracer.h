@@ -0,0 +1,122 @@
+#ifndef API_TRACER_H_
+#define API_TRACER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace api {
+
+/**
+ * Records what single searches spend their time on, as nested spans.
+ *
+ * Tracing is off unless #enable is called: then a span costs a relaxed load
+ * and nothing else. When on, the latest spans are kept in a ring buffer, and
+ * #flush writes them as Chrome trace-event JSON, which chrome://tracing and
+ * Perfetto can open.
+ */
+class Tracer {
+public:
+    static Tracer &instance();
+
+    /**
+     * Start recording the latest capacity spans, to be flushed to path
+     */
+    void enable(const std::string &path, std::size_t capacity = 64 * 1024);
+
+    bool enabled() const {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Write the recorded spans to the path given to #enable, unless none
+     * was recorded since the last time
+     */
+    bool flush();
+
+    void write(std::ostream &out);
+
+    /**
+     * Times the block it lives in. Spans of the same thread nest by time.
+     *
+     * Name and detail must be string literals: only the pointers are kept.
+     */
+    class Span {
+    public:
+        Span(const char *name, const char *detail = nullptr) :
+            name_(name), detail_(detail), active_(instance().enabled()) {
+            if (active_) {
+                started_ = std::chrono::steady_clock::now();
+            }
+        }
+
+        ~Span() {
+            if (active_) {
+                instance().record(name_, detail_, started_,
+                                  std::chrono::steady_clock::now());
+            }
+        }
+
+        Span(const Span &) = delete;
+
+        Span &operator=(const Span &) = delete;
+
+    protected:
+        const char *name_;
+
+        const char *detail_;
+
+        bool active_;
+
+        std::chrono::steady_clock::time_point started_;
+    };
+
+protected:
+    struct Event {
+        const char *name;
+        const char *detail;
+        std::int64_t start;
+        std::int64_t duration;
+        std::uint32_t thread;
+    };
+
+    Tracer();
+
+    void record(const char *name, const char *detail,
+                std::chrono::steady_clock::time_point started,
+                std::chrono::steady_clock::time_point finished);
+
+    std::atomic<bool> enabled_;
+
+    std::mutex mutex_;
+
+    std::string path_;
+
+    /**
+     * The ring buffer, #next_ is where the next span goes
+     */
+    std::vector<Event> events_;
+
+    std::size_t next_;
+
+    bool wrapped_;
+
+    /**
+     * Whether spans were recorded since the last #flush
+     */
+    bool dirty_;
+
+    /**
+     * Timestamps are relative to when tracing started
+     */
+    std::chrono::steady_clock::time_point epoch_;
+};
+
+}
+
+#endif // API_TRACER_H_
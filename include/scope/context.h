@@ -0,0 +1,84 @@
+#ifndef SCOPE_CONTEXT_H_
+#define SCOPE_CONTEXT_H_
+
+#include <api/circuit_breaker.h>
+#include <api/config.h>
+#include <api/disk_cache.h>
+#include <api/http_pool.h>
+#include <api/result_cache.h>
+#include <api/single_flight.h>
+#include <scope/homepage.h>
+#include <scope/prefetcher.h>
+#include <scope/renderers.h>
+#include <scope/scheduler.h>
+#include <scope/stats.h>
+
+#include <memory>
+
+namespace scope {
+
+/**
+ * State shared by all the queries of the scope.
+ *
+ * It's built once in Scope::start, and each Query gets a pointer to it.
+ * Everything in here must be safe to use from concurrent search threads.
+ */
+struct Context {
+    typedef std::shared_ptr<Context> Ptr;
+
+    api::Config::Ptr config;
+
+    /**
+     * Connections to the API, kept alive across queries
+     */
+    api::HttpPool::Ptr pool;
+
+    /**
+     * Makes the requests fail fast while the API is down
+     */
+    api::CircuitBreaker::Ptr breaker;
+
+    /**
+     * Results of the latest queries
+     */
+    api::ResultCache::Ptr cache;
+
+    /**
+     * Results of previous runs of the scope, may be nullptr
+     */
+    api::DiskCache::Ptr disk_cache;
+
+    /**
+     * Fetches of the queries in progress, shared by identical queries
+     */
+    api::SingleFlight::Ptr flights;
+
+    /**
+     * Searches in flight, newer searches of a session abort the older ones
+     */
+    Scheduler::Ptr scheduler;
+
+    /**
+     * The renderers of our categories
+     */
+    Renderers::Ptr renderers;
+
+    /**
+     * Data for the empty query, refreshed in background
+     */
+    Homepage::Ptr homepage;
+
+    /**
+     * Fetches the likely next searches in background
+     */
+    Prefetcher::Ptr prefetcher;
+
+    /**
+     * Writes the metrics for the node agent, may be nullptr
+     */
+    Stats::Ptr stats;
+};
+
+}
+
+#endif // SCOPE_CONTEXT_H_
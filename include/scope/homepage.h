@@ -0,0 +1,78 @@
+#ifndef SCOPE_HOMEPAGE_H_
+#define SCOPE_HOMEPAGE_H_
+
+#include <api/client.h>
+#include <api/config.h>
+#include <api/http_pool.h>
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace scope {
+
+/**
+ * Keeps the data of the page shown for the empty query.
+ *
+ * It's fetched in background when the scope starts and refreshed every
+ * Config::homepage_refresh, so opening the scope never waits for the
+ * network. While a refresh is running the previous data is still served.
+ */
+class Homepage {
+public:
+    typedef std::shared_ptr<Homepage> Ptr;
+
+    /**
+     * Snapshots are immutable, a refresh replaces the whole snapshot
+     */
+    typedef std::shared_ptr<const api::Client::HomePage> Snapshot;
+
+    Homepage(api::Config::Ptr config, api::HttpPool::Ptr pool,
+             api::CircuitBreaker::Ptr breaker = api::CircuitBreaker::Ptr());
+
+    ~Homepage();
+
+    /**
+     * Start refreshing in background
+     */
+    void start();
+
+    /**
+     * Stop refreshing, aborting the running refresh
+     */
+    void stop();
+
+    /**
+     * The latest data, or nullptr if the first refresh didn't finish yet
+     */
+    Snapshot snapshot();
+
+protected:
+    void refresh();
+
+    api::Config::Ptr config_;
+
+    api::HttpPool::Ptr pool_;
+
+    api::CircuitBreaker::Ptr breaker_;
+
+    std::mutex mutex_;
+
+    std::condition_variable wake_;
+
+    bool stopped_;
+
+    Snapshot snapshot_;
+
+    /**
+     * The client of the running refresh, to abort it on #stop
+     */
+    std::shared_ptr<api::Client> client_;
+
+    std::thread worker_;
+};
+
+}
+
+#endif // SCOPE_HOMEPAGE_H_
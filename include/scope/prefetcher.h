@@ -0,0 +1,113 @@
+#ifndef SCOPE_PREFETCHER_H_
+#define SCOPE_PREFETCHER_H_
+
+#include <api/config.h>
+#include <api/disk_cache.h>
+#include <api/result_cache.h>
+#include <api/single_flight.h>
+#include <scope/scheduler.h>
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace scope {
+
+/**
+ * Fetches in background the searches the user is likely to run next.
+ *
+ * After a category or a disambiguation, the user usually taps one of the
+ * first topics: their queries are fetched into the result cache, so that
+ * search doesn't go to the network.
+ *
+ * Prefetches only run while no search is in flight, at most
+ * Config::prefetch_concurrency at a time. A search arriving aborts the
+ * running ones, unless it's waiting for the same results.
+ */
+class Prefetcher: public std::enable_shared_from_this<Prefetcher> {
+public:
+    typedef std::shared_ptr<Prefetcher> Ptr;
+
+    Prefetcher(api::Config::Ptr config, api::SingleFlight::Ptr flights,
+               Scheduler::Ptr scheduler, api::ResultCache::Ptr cache,
+               api::DiskCache::Ptr disk_cache = api::DiskCache::Ptr());
+
+    virtual ~Prefetcher();
+
+    /**
+     * Start the workers, the prefetcher must be owned by a Ptr
+     */
+    void start();
+
+    /**
+     * Stop the workers, aborting the running prefetches
+     */
+    void stop();
+
+    /**
+     * Queue queries to prefetch. Those already cached are skipped, and the
+     * oldest are dropped when the queue is full.
+     */
+    void queue(const std::vector<std::string> &queries);
+
+    /**
+     * A search for query has joined its flight: abort the running
+     * prefetches, except the one of the same query, which the search is
+     * waiting for too
+     */
+    void yield(const std::string &query);
+
+protected:
+    void work();
+
+    /**
+     * Get the results of a query, with the client of its flight
+     */
+    virtual api::Client::QueryResults fetch(api::Client &client,
+                                            const std::string &query);
+
+    /**
+     * Whether no search is in flight, or we are stopped
+     */
+    bool idle();
+
+    api::Config::Ptr config_;
+
+    api::SingleFlight::Ptr flights_;
+
+    Scheduler::Ptr scheduler_;
+
+    api::ResultCache::Ptr cache_;
+
+    api::DiskCache::Ptr disk_cache_;
+
+    std::mutex mutex_;
+
+    std::condition_variable wake_;
+
+    bool stopped_;
+
+    std::deque<std::string> queue_;
+
+    /**
+     * The waiters of the running prefetches, to abort them, with the key of
+     * their flight
+     */
+    std::map<api::SingleFlight::Waiter::Ptr, std::string> running_;
+
+    std::vector<std::thread> workers_;
+
+    /**
+     * The fetches run on the threads of their flights, which may outlive us
+     */
+    std::weak_ptr<Prefetcher> self_;
+};
+
+}
+
+#endif // SCOPE_PREFETCHER_H_
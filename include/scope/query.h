@@ -2,7 +2,15 @@
 #define SCOPE_QUERY_H_
 
 #include <api/client.h>
+#include <scope/context.h>
 
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <string>
+
+#include <unity/scopes/CategorisedResult.h>
+#include <unity/scopes/Category.h>
 #include <unity/scopes/SearchQueryBase.h>
 #include <unity/scopes/ReplyProxyFwd.h>
 
@@ -17,8 +25,14 @@ namespace scope {
  */
 class Query: public unity::scopes::SearchQueryBase {
 public:
+    /**
+     * The department of the "show more" cards, where the lists are pushed
+     * whole
+     */
+    static const std::string FULL;
+
     Query(const unity::scopes::CannedQuery &query,
-          const unity::scopes::SearchMetadata &metadata, api::Config::Ptr config);
+          const unity::scopes::SearchMetadata &metadata, Context::Ptr context);
 
     ~Query() = default;
 
@@ -27,7 +41,100 @@ public:
     void run(const unity::scopes::SearchReplyProxy &reply) override;
 
 private:
-    api::Client client_;
+    /**
+     * Searches of the same session supersede each other. Without the
+     * "session-id" hint it's empty, see Scheduler.
+     */
+    std::string session() const;
+
+    /**
+     * Get the results from DuckDuckGo, nullptr if we have been cancelled.
+     *
+     * The sections filled by the first response are pushed while the others
+     * are still on their way.
+     */
+    api::ResultCache::Entry fetch(const unity::scopes::SearchReplyProxy &reply,
+                                  const std::string &query_string);
+
+    /**
+     * Expired results of a query, from memory or disk, for when the API
+     * can't give us new ones
+     */
+    api::ResultCache::Entry stale(const std::string &key);
+
+    /**
+     * The sections of the results, each one is pushed only once
+     */
+    enum Section {
+        ABSTRACT, INFOBOX, ANSWER, CATEGORY, DISAMBIGUATION, SECTIONS
+    };
+
+    /**
+     * Push the sections we have the data for, and that haven't been pushed
+     * yet. Categories and disambiguations wait for the final results, and
+     * so do the cards missing fields of the abstract the other response may
+     * still bring.
+     *
+     * Returns false if the query has been cancelled.
+     */
+    bool render(const unity::scopes::SearchReplyProxy &reply,
+                const api::Client::QueryResults &queryResults, bool final);
+
+    bool abstract(const unity::scopes::SearchReplyProxy &reply,
+                  const api::Client::QueryResults &queryResults);
+
+    bool infobox(const unity::scopes::SearchReplyProxy &reply,
+                 const api::Client::QueryResults &queryResults);
+
+    bool answer(const unity::scopes::SearchReplyProxy &reply,
+                const api::Client::QueryResults &queryResults);
+
+    bool category(const unity::scopes::SearchReplyProxy &reply,
+                  const api::Client::QueryResults &queryResults);
+
+    bool disambiguation(const unity::scopes::SearchReplyProxy &reply,
+                        const api::Client::QueryResults &queryResults);
+
+    /**
+     * Push the card which shows the whole list of a category, once its
+     * first #cap_ cards are pushed
+     */
+    bool more(const unity::scopes::SearchReplyProxy &reply,
+              const unity::scopes::Category::SCPtr &category,
+              std::size_t total);
+
+    /**
+     * Push a card, measuring when the first one is shown
+     */
+    bool push(const unity::scopes::SearchReplyProxy &reply,
+              const unity::scopes::CategorisedResult &res);
+
+    Context::Ptr context_;
+
+    /**
+     * Guards #cancelled_ and #waiter_, #cancelled is called from a different
+     * thread
+     */
+    std::mutex mutex_;
+
+    bool cancelled_;
+
+    /**
+     * Our place in the shared fetch of the results
+     */
+    api::SingleFlight::Waiter::Ptr waiter_;
+
+    std::chrono::steady_clock::time_point started_;
+
+    bool pushed_[SECTIONS];
+
+    bool first_card_;
+
+    /**
+     * How many cards of each list are pushed, from the form factor and the
+     * cardinality the shell asks for
+     */
+    std::size_t cap_;
 };
 
 }
@@ -0,0 +1,61 @@
+#ifndef SCOPE_RENDERERS_H_
+#define SCOPE_RENDERERS_H_
+
+#include <unity/scopes/CategoryRenderer.h>
+
+#include <memory>
+
+namespace scope {
+
+/**
+ * The renderers of our categories.
+ *
+ * Their templates live in src/scope/templates, they are checked and minified
+ * at build time. The renderers are built once when the scope starts, and
+ * shared read-only by all the queries.
+ */
+struct Renderers {
+    typedef std::shared_ptr<const Renderers> Ptr;
+
+    Renderers();
+
+    /**
+     * Layout for the abstract responses
+     *
+     * The card is large, with a little photo, to have the maximum number of
+     * information available
+     */
+    const unity::scopes::CategoryRenderer abstract;
+
+    /**
+     * Infobox, for a lot of informations :-)
+     *
+     * Cards are little, with only essential informations: the name of the
+     * data, and the data itself
+     */
+    const unity::scopes::CategoryRenderer infobox;
+
+    /**
+     * Answer, for simple questions with a simple answer
+     */
+    const unity::scopes::CategoryRenderer answer;
+
+    /**
+     * List of things related to a topic, the response type has to be C
+     */
+    const unity::scopes::CategoryRenderer categories;
+
+    /**
+     * Disambiguation, it's similar to type C but it's D
+     */
+    const unity::scopes::CategoryRenderer disambiguation;
+
+    /**
+     * 404 page - Nothing return from the query
+     */
+    const unity::scopes::CategoryRenderer empty;
+};
+
+}
+
+#endif // SCOPE_RENDERERS_H_
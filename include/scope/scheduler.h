@@ -0,0 +1,88 @@
+#ifndef SCOPE_SCHEDULER_H_
+#define SCOPE_SCHEDULER_H_
+
+#include <api/config.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace scope {
+
+/**
+ * Tracks the searches in flight for each session.
+ *
+ * While the user types, each keystroke is a new search: as soon as a newer
+ * search of the same session arrives, the older ones are aborted, instead of
+ * waiting for the shell to cancel them. Very short prefixes are also held
+ * back for Config::debounce, as they are usually superseded right away.
+ *
+ * A search without a session (an empty one) supersedes nothing and is
+ * superseded by nothing, so it's never held back either.
+ */
+class Scheduler {
+public:
+    typedef std::shared_ptr<Scheduler> Ptr;
+
+    /**
+     * Abort a search, called with the scheduler locked: it must not call
+     * back into the scheduler
+     */
+    typedef std::function<void()> Abort;
+
+    Scheduler(api::Config::Ptr config);
+
+    /**
+     * Register a new search, aborting the older ones of its session.
+     *
+     * Returns the id of the search, to pass to the other methods.
+     */
+    std::uint64_t admit(const std::string &session, const Abort &abort);
+
+    /**
+     * Hold back short queries before they go to the network.
+     *
+     * Returns false if the search has been superseded in the meantime.
+     */
+    bool debounce(const std::string &session, std::uint64_t id,
+                  const std::string &query);
+
+    /**
+     * The search is over, forget about it
+     */
+    void finish(const std::string &session, std::uint64_t id);
+
+    /**
+     * Searches in flight, across all the sessions
+     */
+    std::size_t active();
+
+    /**
+     * Wake up all the searches waiting in #debounce
+     */
+    void stop();
+
+protected:
+    api::Config::Ptr config_;
+
+    std::mutex mutex_;
+
+    std::condition_variable changed_;
+
+    std::uint64_t next_id_;
+
+    bool stopped_;
+
+    /**
+     * For each session, the searches in flight by id (newest last)
+     */
+    std::map<std::string, std::map<std::uint64_t, Abort>> sessions_;
+};
+
+}
+
+#endif // SCOPE_SCHEDULER_H_
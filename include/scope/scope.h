@@ -1,7 +1,7 @@
 #ifndef SCOPE_SCOPE_H_
 #define SCOPE_SCOPE_H_
 
-#include <api/config.h>
+#include <scope/context.h>
 
 #include <unity/scopes/ScopeBase.h>
 #include <unity/scopes/QueryBase.h>
@@ -45,7 +45,10 @@ public:
             unity::scopes::SearchMetadata const&) override;
 
 protected:
-    api::Config::Ptr config_;
+    /**
+     * State shared by all the queries
+     */
+    Context::Ptr context_;
 };
 
 }
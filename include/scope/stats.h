@@ -0,0 +1,78 @@
+#ifndef SCOPE_STATS_H_
+#define SCOPE_STATS_H_
+
+#include <api/circuit_breaker.h>
+#include <api/config.h>
+#include <api/http_pool.h>
+#include <api/result_cache.h>
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+
+namespace scope {
+
+/**
+ * Writes the metrics of the scope to a file, in the Prometheus text format.
+ *
+ * The file is written every Config::stats_interval, and once more when the
+ * scope stops, so a node agent can collect it. It's replaced atomically: a
+ * reader never sees it half written.
+ *
+ * When tracing is on, the trace is written along with it.
+ */
+class Stats {
+public:
+    typedef std::shared_ptr<Stats> Ptr;
+
+    Stats(api::Config::Ptr config, const std::string &path,
+          api::HttpPool::Ptr pool, api::CircuitBreaker::Ptr breaker,
+          api::ResultCache::Ptr cache);
+
+    ~Stats();
+
+    /**
+     * Start writing in background
+     */
+    void start();
+
+    /**
+     * Stop writing, after a last time
+     */
+    void stop();
+
+    /**
+     * Write all the metrics, api::Metrics and the state of the shared objects
+     */
+    void write(std::ostream &out);
+
+protected:
+    void run();
+
+    bool flush();
+
+    api::Config::Ptr config_;
+
+    std::string path_;
+
+    api::HttpPool::Ptr pool_;
+
+    api::CircuitBreaker::Ptr breaker_;
+
+    api::ResultCache::Ptr cache_;
+
+    std::mutex mutex_;
+
+    std::condition_variable wake_;
+
+    bool stopped_;
+
+    std::thread worker_;
+};
+
+}
+
+#endif // SCOPE_STATS_H_
@@ -0,0 +1,30 @@
+#ifndef SCOPE_TOPIC_H_
+#define SCOPE_TOPIC_H_
+
+#include <boost/utility/string_ref.hpp>
+
+namespace scope {
+
+/**
+ * The pieces of the HTML of a related topic, which is a link followed by
+ * its description, like:
+ *
+ * <a href="https://duckduckgo.com/Ferrara">Ferrara</a> - A city in Italy
+ */
+struct Topic {
+    /**
+     * Views into the HTML of the topic
+     */
+    boost::string_ref title;
+    boost::string_ref summary;
+
+    /**
+     * Split the HTML of a topic. The separator between the link and the
+     * description, if there, is not a part of the summary.
+     */
+    static Topic parse(boost::string_ref result, boost::string_ref separator);
+};
+
+}
+
+#endif // SCOPE_TOPIC_H_
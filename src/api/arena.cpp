@@ -0,0 +1,107 @@
+#include <api/arena.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+using namespace api;
+using namespace std;
+
+namespace {
+
+/**
+ * Smallest block allocated when the text doesn't fit: most fields are
+ * short, so they share a few blocks
+ */
+const size_t BLOCK_SIZE = 4096;
+
+}
+
+Arena::Arena() :
+    next_(nullptr), left_(0), size_(0), adopted_(0) {
+}
+
+Arena::Arena(Arena &&other) :
+    Arena() {
+    *this = move(other);
+}
+
+Arena &Arena::operator=(Arena &&other) {
+    if (this != &other) {
+        blocks_ = move(other.blocks_);
+        documents_ = move(other.documents_);
+        next_ = other.next_;
+        left_ = other.left_;
+        size_ = other.size_;
+        adopted_ = other.adopted_;
+        other.blocks_.clear();
+        other.documents_.clear();
+        other.next_ = nullptr;
+        other.left_ = 0;
+        other.size_ = 0;
+        other.adopted_ = 0;
+    }
+    return *this;
+}
+
+void Arena::reserve(size_t size) {
+    if (size <= left_) {
+        return;
+    }
+    size = max(size, BLOCK_SIZE);
+    blocks_.emplace_back(new char[size]);
+    next_ = blocks_.back().get();
+    left_ = size;
+}
+
+boost::string_ref Arena::store(const char *data, size_t size) {
+    if (size == 0) {
+        return boost::string_ref();
+    }
+    reserve(size);
+
+    char *text = next_;
+    memcpy(text, data, size);
+    next_ += size;
+    left_ -= size;
+    size_ += size;
+    return boost::string_ref(text, size);
+}
+
+void Arena::adopt(Arena &&other) {
+    blocks_.insert(blocks_.end(),
+                   make_move_iterator(other.blocks_.begin()),
+                   make_move_iterator(other.blocks_.end()));
+    documents_.insert(documents_.end(),
+                      make_move_iterator(other.documents_.begin()),
+                      make_move_iterator(other.documents_.end()));
+
+    // Go on filling whichever block has more room
+    if (other.left_ > left_) {
+        next_ = other.next_;
+        left_ = other.left_;
+    }
+    size_ += other.size_;
+    adopted_ += other.adopted_;
+
+    other.blocks_.clear();
+    other.documents_.clear();
+    other.next_ = nullptr;
+    other.left_ = 0;
+    other.size_ = 0;
+    other.adopted_ = 0;
+}
+
+string &Arena::adopt(string &&document) {
+    adopted_ += document.size();
+    documents_.emplace_back(new string(move(document)));
+    return *documents_.back();
+}
+
+size_t Arena::size() const {
+    return size_;
+}
+
+size_t Arena::adopted() const {
+    return adopted_;
+}
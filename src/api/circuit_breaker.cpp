@@ -0,0 +1,104 @@
+#include <api/circuit_breaker.h>
+
+#include <algorithm>
+
+using namespace api;
+using namespace std;
+
+CircuitBreaker::CircuitBreaker(Config::Ptr config) :
+    config_(config), state_(State::closed), failures_(0), probing_(false),
+    backoff_(config->breaker_backoff), random_(random_device()()),
+    rejected_(0) {
+}
+
+bool CircuitBreaker::allow() {
+    lock_guard<mutex> lock(mutex_);
+
+    switch (state_) {
+    case State::closed:
+        return true;
+
+    case State::open:
+        // Time to find out whether the API is back
+        if (Clock::now() >= retry_at_) {
+            state_ = State::half_open;
+            probing_ = true;
+            return true;
+        }
+        break;
+
+    case State::half_open:
+        // The probe has been abandoned
+        if (!probing_) {
+            probing_ = true;
+            return true;
+        }
+        break;
+    }
+
+    ++rejected_;
+    return false;
+}
+
+void CircuitBreaker::success() {
+    lock_guard<mutex> lock(mutex_);
+    state_ = State::closed;
+    failures_ = 0;
+    probing_ = false;
+    backoff_ = config_->breaker_backoff;
+}
+
+void CircuitBreaker::failure() {
+    lock_guard<mutex> lock(mutex_);
+
+    switch (state_) {
+    case State::closed:
+        if (++failures_ >= config_->breaker_failures) {
+            trip();
+        }
+        break;
+
+    case State::half_open:
+        // Still down: wait longer before the next probe
+        backoff_ = min<Clock::duration>(backoff_ * 2,
+                                        config_->breaker_max_backoff);
+        trip();
+        break;
+
+    case State::open:
+        // Requests sent before we opened may still be coming back
+        break;
+    }
+}
+
+void CircuitBreaker::abandon() {
+    lock_guard<mutex> lock(mutex_);
+
+    // Let another request probe in its place
+    if (state_ == State::half_open) {
+        probing_ = false;
+    }
+}
+
+void CircuitBreaker::trip() {
+    // Equal jitter: between half and the whole backoff
+    auto half = backoff_ / 2;
+    uniform_int_distribution<Clock::rep> jitter(0, half.count());
+
+    state_ = State::open;
+    probing_ = false;
+    retry_at_ = Clock::now() + half + Clock::duration(jitter(random_));
+}
+
+CircuitBreaker::State CircuitBreaker::state() {
+    lock_guard<mutex> lock(mutex_);
+    return state_;
+}
+
+bool CircuitBreaker::tripped() {
+    return state() != State::closed;
+}
+
+uint64_t CircuitBreaker::rejected() const {
+    return rejected_;
+}
@@ -1,81 +1,330 @@
 #include <api/client.h>
+#include <api/decoder.h>
+#include <api/ingest.h>
+#include <api/metrics.h>
+#include <api/tracer.h>
 
 #include <core/net/error.h>
 #include <core/net/http/client.h>
 #include <core/net/http/content_type.h>
 #include <core/net/http/response.h>
-#include <QVariantMap>
 #include <QDebug>
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <future>
+#include <iostream>
+
 namespace http = core::net::http;
 namespace net = core::net;
 
 using namespace api;
 using namespace std;
 
-Client::Client(Config::Ptr config) :
-    config_(config), cancelled_(false) {
+namespace {
+
+typedef Client::QueryResults QueryResults;
+
+/**
+ * How a field of the results is merged, and when the ?q= response missing it
+ * is worth a second request
+ */
+struct Field {
+    /**
+     * Types of response (the first letter of Type) expected to have this
+     * field. If the ?q= response misses it, we ask again with the path form.
+     */
+    const char *expected;
+
+    bool (*missing)(const QueryResults &results);
+
+    /**
+     * Take the field from the other results, if we miss it
+     */
+    void (*take)(QueryResults &ours, QueryResults &theirs);
+};
+
+template<typename T, T QueryResults::*Member>
+bool missing(const QueryResults &results) {
+    return (results.*Member).empty();
+}
+
+template<typename T, T QueryResults::*Member>
+void take(QueryResults &ours, QueryResults &theirs) {
+    if ((ours.*Member).empty()) {
+        swap(ours.*Member, theirs.*Member);
+    }
+}
+
+template<typename S, S QueryResults::*Section, boost::string_ref S::*Member>
+bool missing(const QueryResults &results) {
+    return (results.*Section.*Member).empty();
+}
+
+template<typename S, S QueryResults::*Section, boost::string_ref S::*Member>
+void take(QueryResults &ours, QueryResults &theirs) {
+    if ((ours.*Section.*Member).empty()) {
+        swap(ours.*Section.*Member, theirs.*Section.*Member);
+    }
+}
+
+#define SECTION_FIELD(expected, S, section, member) \
+    { expected, \
+      &missing<Client::S, &QueryResults::section, &Client::S::member>, \
+      &take<Client::S, &QueryResults::section, &Client::S::member> }
+
+#define FIELD(expected, T, member) \
+    { expected, \
+      &missing<T, &QueryResults::member>, \
+      &take<T, &QueryResults::member> }
+
+/**
+ * The fields we read from the responses.
+ *
+ * Lists are taken whole: we don't mix items of the two responses.
+ */
+const Field FIELDS[] = {
+    SECTION_FIELD("", Abstract, abstract, summary),
+    SECTION_FIELD("A", Abstract, abstract, textSummary),
+    SECTION_FIELD("", Abstract, abstract, source),
+    SECTION_FIELD("", Abstract, abstract, url),
+    SECTION_FIELD("", Abstract, abstract, imageUrl),
+    SECTION_FIELD("ACD", Abstract, abstract, heading),
+    SECTION_FIELD("E", Answer, answer, instantAnswer),
+    SECTION_FIELD("E", Answer, answer, type),
+    SECTION_FIELD("", Definition, definition, definition),
+    SECTION_FIELD("", Definition, definition, source),
+    SECTION_FIELD("", Definition, definition, url),
+    FIELD("", boost::string_ref, type),
+    FIELD("A", Client::Infobox, infobox),
+    FIELD("CD", Client::RelatedTopics, relatedTopics),
+    FIELD("", Client::Results, results),
+};
+
+#undef FIELD
+#undef SECTION_FIELD
+
+/**
+ * Whether the path form could complete the ?q= results
+ */
+bool incomplete(const QueryResults &results) {
+    // DuckDuckGo found nothing, the other form may find something
+    if (results.type.empty()) {
+        return true;
+    }
+    for (const Field &field : FIELDS) {
+        if (strchr(field.expected, results.type[0]) && field.missing(results)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+Client::Client(Config::Ptr config, HttpPool::Ptr pool,
+               CircuitBreaker::Ptr breaker) :
+    config_(config), pool_(pool), breaker_(breaker),
+    cancelled_(make_shared<atomic<bool>>(false)),
+    deadline_(chrono::steady_clock::time_point::max()) {
 }
 
 void Client::get(const net::Uri::Path &path,
-                 const net::Uri::QueryParameters &parameters, QJsonDocument &root) {
-    // Create a new HTTP client
-    auto client = http::make_client();
+                 const net::Uri::QueryParameters &parameters, QueryResults &results) {
+    Tracer::Span span("Client::get", path.empty() ? "query" : "path");
+
+    // Without a shared pool, create a new HTTP client
+    shared_ptr<http::Client> client;
+    if (!pool_) {
+        client = http::make_client();
+    }
 
     // Start building the request configuration
     http::Request::Configuration configuration;
 
     // Build the URI from its components
     net::Uri uri = net::make_uri(config_->apiroot, path, parameters);
-    configuration.uri = client->uri_to_string(uri);
+    configuration.uri = pool_ ? pool_->uri_to_string(uri) :
+        client->uri_to_string(uri);
 
     // Give out a user agent string
     configuration.header.add("User-Agent", config_->user_agent);
 
-    // Build a HTTP request object from our configuration
-    auto request = client->head(configuration);
+    // The request gets its own timeouts, but never outlives its search
+    auto now = chrono::steady_clock::now();
+    auto connect_by = now + config_->connect_timeout;
+    auto deadline = now + config_->request_timeout;
+    if (deadline_ < deadline) {
+        deadline = deadline_;
+    }
+    if (now >= deadline) {
+        results.degraded = true;
+        return;
+    }
+
+    // While the API is down, don't even try
+    if (breaker_ && !breaker_->allow()) {
+        results.degraded = true;
+        return;
+    }
+
+    // However the request ends, the breaker hears of it: a probe nobody
+    // reports on would keep it half-open, rejecting every request
+    struct Outcome {
+        CircuitBreaker *breaker;
+        bool reported;
+        void success() {
+            reported = true;
+            if (breaker) {
+                breaker->success();
+            }
+        }
+        void failure() {
+            reported = true;
+            if (breaker) {
+                breaker->failure();
+            }
+        }
+        void abandon() {
+            reported = true;
+            if (breaker) {
+                breaker->abandon();
+            }
+        }
+        ~Outcome() {
+            if (!reported) {
+                abandon();
+            }
+        }
+    } outcome { breaker_.get(), false };
+
+    Metrics &metrics = Metrics::instance();
+    ++metrics.requests;
+
+    // Set when we abort the request ourselves, as it stalled or ran out of
+    // time
+    auto gave_up = make_shared<atomic<bool>>(false);
 
     try {
         // Synchronously make the HTTP request
-        // We bind the cancellable callback to #progress_report
-        auto response = request->execute(
-                    bind(&Client::progress_report, this, placeholders::_1));
+        // The cancellable callback is #progress_report, and it tells us when
+        // the response starts. It may be called after we return, even after
+        // we are gone, so it only holds shared state.
+        auto first_byte = make_shared<atomic<chrono::steady_clock::rep>>(0);
+        auto cancelled = cancelled_;
+        auto progress = [cancelled, connect_by, deadline, first_byte, gave_up](
+                const http::Request::Progress &p) {
+            if (p.download.current > 0 && *first_byte == 0) {
+                *first_byte = chrono::steady_clock::now().time_since_epoch().count();
+            }
+            auto next = progress_report(p, *cancelled, connect_by, deadline);
+            if (next == http::Request::Progress::Next::abort_operation) {
+                *gave_up = true;
+            }
+            return next;
+        };
+        http::Response response;
+        if (pool_) {
+            // The two forms of the query are answered by different endpoints,
+            // with their own latencies
+            response = pool_->execute(configuration, progress, deadline,
+                                      path.empty() ? "query" : "path",
+                                      cancelled_.get());
+        } else {
+            // Build a HTTP request object from our configuration
+            auto request = client->head(configuration);
+            request->set_timeout(chrono::duration_cast<chrono::milliseconds>(
+                    deadline - now));
+            response = request->execute(progress);
+        }
+
+        // A small response may arrive whole before any progress is reported
+        auto done = chrono::steady_clock::now();
+        auto first = done;
+        if (*first_byte != 0) {
+            first = chrono::steady_clock::time_point(
+                    chrono::steady_clock::duration(*first_byte));
+        }
+        metrics.first_byte.record(
+                chrono::duration_cast<chrono::microseconds>(first - now));
+        metrics.transfer.record(
+                chrono::duration_cast<chrono::microseconds>(done - first));
+
+        // The API is in trouble: like a failed request, the search goes on
+        // with what the other requests bring
+        if (static_cast<int>(response.status) >= 500) {
+            outcome.failure();
+            results.degraded = true;
+            ++metrics.http_errors;
+            cerr << "Request failed: HTTP " << static_cast<int>(response.status)
+                 << endl;
+            return;
+        }
+        outcome.success();
 
         // Check that we got a sensible HTTP status code
         if (response.status != http::Status::ok) {
+            ++metrics.http_errors;
             throw domain_error(response.body);
         }
-        // Parse the JSON from the response
-        root = QJsonDocument::fromJson(response.body.c_str());
-    } catch (net::Error &) {
+        // Decode the JSON from the response
+        Metrics::Timer timer(metrics.decode);
+        Tracer::Span decode("decode");
+        Decoder::decode(move(response.body), results);
+        Ingest::clean(results);
+    } catch (net::Error &e) {
+        // The search goes on with what the other requests bring, but the
+        // results are not complete
+        results.degraded = true;
+        ++metrics.request_errors;
+
+        // If we aborted it, or it ran out of our time, it tells nothing
+        // about the API: a slow link would open the breaker otherwise
+        if (*cancelled_) {
+            outcome.abandon();
+        } else if (*gave_up || chrono::steady_clock::now() >= deadline) {
+            outcome.abandon();
+            cerr << "Request gave up: " << e.what() << endl;
+        } else {
+            outcome.failure();
+            cerr << "Request failed: " << e.what() << endl;
+        }
     }
 }
 
 Client::HomePage Client::homepageResults(const string &query) {
-    QJsonDocument fortuneCookie, sunriseQuery;
     HomePage homepage;
     // First of all, we want a random fortune cookie :-)
-    get( {}, {{"q", "fortune cookie"}, {"format", "json"}, {"no_html", "1"},
-            {"t", "discerningduck"}}, fortuneCookie);
-
-    QVariantMap fortune = fortuneCookie.toVariant().toMap();
-    homepage.fortune.instantAnswer = fortune["Answer"].toString().toStdString();
-    homepage.fortune.type = fortune["AnswerType"].toString().toStdString();
+    // Both requests are independent, so they are made at the same time
+    auto fortuneFuture = async(launch::async, [this]() {
+        QueryResults fortune;
+        get( {}, {{"q", "fortune cookie"}, {"format", "json"}, {"no_html", "1"},
+                {"t", "discerningduck"}}, fortune);
+        return fortune;
+    });
 
     // Sunrise of the day
     // TODO: add location
-    get( {}, {{"q", "sunrise"}, {"format", "json"},
-            {"t", "discerningduck"}}, sunriseQuery);
-
-    QVariantMap sunrise = sunriseQuery.toVariant().toMap();
-    homepage.sunrise.instantAnswer = sunrise["Answer"].toString().toStdString();
-    homepage.sunrise.type = sunrise["AnswerType"].toString().toStdString();
+    auto sunriseFuture = async(launch::async, [this]() {
+        QueryResults sunrise;
+        get( {}, {{"q", "sunrise"}, {"format", "json"},
+                {"t", "discerningduck"}}, sunrise);
+        return sunrise;
+    });
+
+    QueryResults fortune = fortuneFuture.get();
+    QueryResults sunrise = sunriseFuture.get();
+    homepage.fortune = fortune.answer;
+    homepage.sunrise = sunrise.answer;
+    homepage.arena.adopt(move(fortune.arena));
+    homepage.arena.adopt(move(sunrise.arena));
     return homepage;
 }
 
-Client::QueryResults Client::queryResults(const string& query) {
-    QJsonDocument queryResultsWithQ, queryResultsWithoutQ;
-    QueryResults queryResults;
+Client::QueryResults Client::queryResults(const string& query,
+                                          const Partial &partial) {
+    Tracer::Span span("Client::queryResults");
 
     // Build a URI and get the contents.
     // The fist parameter forms the path part of the URI.
@@ -83,14 +332,22 @@ Client::QueryResults Client::queryResults(const string& query) {
     //
     // Because some html answers don't work, ask to DuckDuckGo only plain text
     // responses
-    get( {}, {{"q", query}, {"format", "json"}, {"no_html", "1"},
-            {"t", "discerningduck"}}, queryResultsWithQ);
+    auto withQ = [this, &query]() {
+        QueryResults results;
+        get( {}, {{"q", query}, {"format", "json"}, {"no_html", "1"},
+                {"t", "discerningduck"}}, results);
+        return results;
+    };
     // e.g. http://api.duckduckgo.com/?q=QUERY&format=json&no_html=1&t=discerningduck
     //
     // The answer of these two queries sometimes are different, we need to
     // take best of both
-    get( {query}, {{"format", "json"}, {"no_html", "1"},
-            {"t", "discerningduck"}}, queryResultsWithoutQ);
+    auto withoutQ = [this, &query]() {
+        QueryResults results;
+        get( {query}, {{"format", "json"}, {"no_html", "1"},
+                {"t", "discerningduck"}}, results);
+        return results;
+    };
     // e.g. http://api.duckduckgo.com/QUERY&format=json&no_html=1&t=discerningduck
     //
     // See https://api.duckduckgo.com/?q=ferrara&format=json&pretty=1 (no
@@ -100,137 +357,139 @@ Client::QueryResults Client::queryResults(const string& query) {
     // https://api.duckduckgo.com/3*2&format=json&pretty=1 (no answer) and
     // https://api.duckduckgo.com/?q=3*2&format=json&pretty=1
 
-    // Read out the abstract we found and take best results
-    QVariantMap variantWithQ = queryResultsWithQ.toVariant().toMap();
-    QVariantMap variantWithoutQ = queryResultsWithoutQ.toVariant().toMap();
-
-    queryResults.abstract.summary = variantWithQ["Abstract"].toString().toStdString() != "" ?
-        variantWithQ["Abstract"].toString().toStdString() :
-        variantWithoutQ["Abstract"].toString().toStdString();
-    queryResults.abstract.textSummary = variantWithQ["AbstractText"].toString().toStdString() != "" ?
-        variantWithQ["AbstractText"].toString().toStdString() :
-        variantWithoutQ["AbstractText"].toString().toStdString();
-    queryResults.abstract.source = variantWithQ["AbstractSource"].toString().toStdString() != "" ?
-        variantWithQ["AbstractSource"].toString().toStdString() :
-        variantWithoutQ["AbstractSource"].toString().toStdString();
-    queryResults.abstract.url = variantWithQ["AbstractURL"].toString().toStdString() != "" ?
-        variantWithQ["AbstractURL"].toString().toStdString() :
-        variantWithoutQ["AbstractURL"].toString().toStdString();
-    queryResults.abstract.imageUrl = variantWithQ["Image"].toString().toStdString() != "" ?
-        variantWithQ["Image"].toString().toStdString() :
-        variantWithoutQ["Image"].toString().toStdString();
-    queryResults.abstract.heading = variantWithQ["Heading"].toString().toStdString() != "" ?
-        variantWithQ["Heading"].toString().toStdString() :
-        variantWithoutQ["Heading"].toString().toStdString();
-
-    queryResults.answer.instantAnswer = variantWithQ["Answer"].toString().toStdString() != "" ?
-        variantWithQ["Answer"].toString().toStdString() :
-        variantWithoutQ["Answer"].toString().toStdString();
-    queryResults.answer.type = variantWithQ["AnswerType"].toString().toStdString() != "" ?
-        variantWithQ["AnswerType"].toString().toStdString() :
-        variantWithoutQ["AnswerType"].toString().toStdString();
-
-    queryResults.definition.definition = variantWithQ["Definition"].toString().toStdString() != "" ?
-        variantWithQ["Definition"].toString().toStdString() :
-        variantWithoutQ["Definition"].toString().toStdString();
-    queryResults.definition.source = variantWithQ["DefinitionSource"].toString().toStdString() != "" ?
-        variantWithQ["DefinitionSource"].toString().toStdString() :
-        variantWithoutQ["DefinitionSouce"].toString().toStdString();
-    queryResults.definition.url = variantWithQ["DefinitionURL"].toString().toStdString() != "" ?
-        variantWithQ["DefinitionURL"].toString().toStdString() :
-        variantWithoutQ["DefinitionURL"].toString().toStdString();
-
-    queryResults.type = variantWithQ["Type"].toString().toStdString() != "" ?
-        variantWithQ["Type"].toString().toStdString() :
-        variantWithoutQ["Type"].toString().toStdString();
-
-    QVariantMap infobox = variantWithQ["Infobox"].toMap();
-    QVariantList content = infobox["content"].toList();
-
-    int hasInfoboxData = 0;
-    for (const QVariant &c : content) {
-        hasInfoboxData = 1;
-        QVariantMap item = c.toMap();
-        queryResults.infobox.emplace_back(
-            Content {
-                item["data_type"].toString().toStdString(),
-                item["value"].toString().toStdString(),
-                item["label"].toString().toStdString(),
-                item["wiki_order"].toUInt()
-            }
-        );
-    }
+    // Past the deadline the requests still in flight are aborted, and we
+    // make do with what we have
+    deadline_ = chrono::steady_clock::now() + config_->query_deadline;
+
+    // The results with q are preferred, and completed by the other ones
+    QueryResults queryResults;
 
-    if (hasInfoboxData == 0) {
-        infobox = variantWithoutQ["Infobox"].toMap();
-        content = infobox["content"].toList();
-
-        for (const QVariant &c : content) {
-            QVariantMap item = c.toMap();
-            queryResults.infobox.emplace_back(
-                Content {
-                    item["data_type"].toString().toStdString(),
-                    item["value"].toString().toStdString(),
-                    item["label"].toString().toStdString(),
-                    item["wiki_order"].toUInt()
-                }
-            );
+    // Count the searches which couldn't get everything
+    Metrics &metrics = Metrics::instance();
+    struct Degraded {
+        const QueryResults &results;
+        const atomic<bool> &cancelled;
+        Metrics &metrics;
+        ~Degraded() {
+            if (results.degraded && !cancelled) {
+                ++metrics.degraded;
+            }
         }
-    }
+    } degraded { queryResults, *cancelled_, metrics };
 
-    int hasRelatedData = 0;
-    QVariantList related = variantWithQ["RelatedTopics"].toList();
-    for (const QVariant &r : related) {
-        hasRelatedData = 1;
-        QVariantMap result = r.toMap();
-        QVariantMap icon = result["Icon"].toMap();
-        queryResults.relatedTopics.emplace_back(
-            Result {
-                result["Result"].toString().toStdString(),
-                result["FirstURL"].toString().toStdString(),
-                Icon {
-                    icon["URL"].toString().toStdString(),
-                    icon["Height"].toUInt(),
-                    icon["Width"].toUInt()
-                },
-                result["Text"].toString().toStdString()
+    // Show what the first response has, while we wait for the second one
+    auto show = [this, &partial](const QueryResults &results) {
+        if (partial && !*cancelled_ && !results.isEmpty()) {
+            partial(results);
+        }
+    };
+
+    if (config_->second_fetch == Config::SecondFetch::when_incomplete) {
+        // Only ask again if the first response misses something
+        queryResults = withQ();
+        if (*cancelled_) {
+            // Nobody wants the results anymore, this isn't a skip
+            ++metrics.second_fetch_cancelled;
+            return queryResults;
+        }
+        bool late = chrono::steady_clock::now() >= deadline_;
+        if (late || !incomplete(queryResults)) {
+            // There is no time left to complete them
+            if (late && incomplete(queryResults)) {
+                queryResults.degraded = true;
             }
-        );
+            ++metrics.second_fetch_skipped;
+            return queryResults;
+        }
+        ++metrics.second_fetch_sent;
+        show(queryResults);
+        QueryResults other = withoutQ();
+
+        Metrics::Timer timer(metrics.merge);
+        Tracer::Span merge("merge");
+        queryResults.merge(move(other));
+        return queryResults;
     }
 
-    if (hasRelatedData == 0) {
-        related = variantWithoutQ["RelatedTopics"].toList();
-        for (const QVariant &r : related) {
-            QVariantMap result = r.toMap();
-            QVariantMap icon = result["Icon"].toMap();
-            queryResults.relatedTopics.emplace_back(
-                Result {
-                    result["Result"].toString().toStdString(),
-                    result["FirstURL"].toString().toStdString(),
-                    Icon {
-                        icon["URL"].toString().toStdString(),
-                        icon["Height"].toUInt(),
-                        icon["Width"].toUInt()
-                    },
-                    result["Text"].toString().toStdString()
-                }
-            );
-        }
+    // Both requests are issued at the same time, so a search pays for one
+    // round trip instead of two. Both share #cancelled_ through
+    // #progress_report, so cancelling the query aborts them together.
+    auto withQFuture = async(launch::async, withQ);
+    auto withoutQFuture = async(launch::async, withoutQ);
+    ++metrics.second_fetch_sent;
+
+    // Only the preferred response is shown before the merge: what is shown
+    // stays, and the merge could replace a section of the other one
+    queryResults = withQFuture.get();
+    if (withoutQFuture.wait_for(chrono::seconds(0)) != future_status::ready) {
+        show(queryResults);
     }
+    QueryResults other = withoutQFuture.get();
 
+    Metrics::Timer timer(metrics.merge);
+    Tracer::Span merge("merge");
+    queryResults.merge(move(other));
     return queryResults;
 }
 
+void Client::QueryResults::merge(QueryResults &&other) {
+    // Take best results, field by field
+    for (const Field &field : FIELDS) {
+        field.take(*this, other);
+    }
+    degraded = degraded || other.degraded;
+
+    // What we took still points into the other arena
+    arena.adopt(move(other.arena));
+}
+
+Client::QueryResults Client::QueryResults::copy() const {
+    QueryResults copy;
+    copy.abstract = abstract;
+    copy.answer = answer;
+    copy.definition = definition;
+    copy.infobox = infobox;
+    copy.relatedTopics = relatedTopics;
+    copy.results = results;
+    copy.type = type;
+    copy.degraded = degraded;
+
+    // The views still point into our arena, until they are stored in the new
+    // one
+    Arena &text = copy.arena;
+    text.reserve(arena.size() + arena.adopted());
+    copy.for_each_text([&text](boost::string_ref &field) {
+        field = text.store(field);
+    });
+    return copy;
+}
+
 http::Request::Progress::Next Client::progress_report(
-        const http::Request::Progress&) {
+        const http::Request::Progress& progress, const atomic<bool> &cancelled,
+        chrono::steady_clock::time_point connect_by,
+        chrono::steady_clock::time_point deadline) {
+    auto now = chrono::steady_clock::now();
+
+    // net-cpp doesn't tell us when the connection is up, the first byte of
+    // the response is our sign that it is
+    bool stalled = progress.download.current <= 0 && now > connect_by;
 
-    return cancelled_ ?
+    return cancelled || stalled || now > deadline ?
                 http::Request::Progress::Next::abort_operation :
                 http::Request::Progress::Next::continue_operation;
 }
 
 void Client::cancel() {
-    cancelled_ = true;
+    *cancelled_ = true;
+
+    // A request may still be waiting for a connection
+    if (pool_) {
+        pool_->wake();
+    }
+}
+
+bool Client::cancelled() const {
+    return *cancelled_;
 }
 
 Config::Ptr Client::config() {
@@ -0,0 +1,580 @@
+#include <api/decoder.h>
+#include <api/ingest.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+using namespace api;
+using namespace std;
+
+namespace {
+
+/**
+ * Pull reader over a JSON document.
+ *
+ * Every method consumes one value, and returns false on malformed input.
+ */
+class Reader {
+public:
+    /**
+     * The text read is copied in the arena, or with a writable document,
+     * decoded over the document
+     */
+    Reader(const char *data, size_t size, Arena &arena,
+           char *document = nullptr) :
+        data_(data), p_(data), end_(data + size), arena_(arena),
+        document_(document) {
+    }
+
+    /**
+     * Read an object, calling member(key) to consume the value of each key
+     */
+    template<typename Member>
+    bool object(Member member) {
+        if (!consume('{')) {
+            return false;
+        }
+        if (consume('}')) {
+            return true;
+        }
+        do {
+            skip_whitespace();
+            if (!string_value(&key_) || !consume(':')) {
+                return false;
+            }
+            if (!member(key_)) {
+                return false;
+            }
+        } while (consume(','));
+        return consume('}');
+    }
+
+    /**
+     * Read an array, calling element() to consume each element
+     */
+    template<typename Element>
+    bool array(Element element) {
+        if (!consume('[')) {
+            return false;
+        }
+        if (consume(']')) {
+            return true;
+        }
+        do {
+            if (!element()) {
+                return false;
+            }
+        } while (consume(','));
+        return consume(']');
+    }
+
+    /**
+     * Read a value as a string: numbers and booleans keep their text, null,
+     * objects and arrays are empty
+     */
+    bool text(boost::string_ref &out) {
+        out.clear();
+        switch (peek()) {
+        case '"':
+            if (document_) {
+                return string_in_place(out);
+            }
+            if (!string_value(&scratch_)) {
+                return false;
+            }
+            out = arena_.store(scratch_.data(), scratch_.size());
+            return true;
+        case '{':
+        case '[':
+        case 'n':
+            return skip();
+        default:
+            const char *start = p_;
+            if (!skip()) {
+                return false;
+            }
+            out = keep(start);
+            return true;
+        }
+    }
+
+    /**
+     * Read a value as an unsigned number: numeric strings are converted,
+     * anything else is 0
+     */
+    bool number(unsigned int &out) {
+        out = 0;
+        char c = peek();
+        if (c == '"') {
+            if (!string_value(&scratch_)) {
+                return false;
+            }
+            out = to_unsigned(scratch_.data(), scratch_.data() + scratch_.size());
+            return true;
+        }
+        if (c == '-' || (c >= '0' && c <= '9')) {
+            const char *start = p_;
+            if (!skip()) {
+                return false;
+            }
+            out = to_unsigned(start, p_);
+            return true;
+        }
+        return skip();
+    }
+
+    /**
+     * Whether the next value is an object
+     */
+    bool is_object() {
+        return peek() == '{';
+    }
+
+    bool is_array() {
+        return peek() == '[';
+    }
+
+    /**
+     * Consume a value we don't need, without building it
+     */
+    bool skip() {
+        switch (peek()) {
+        case '{':
+            return object([this](const string &) {
+                return skip();
+            });
+        case '[':
+            return array([this]() {
+                return skip();
+            });
+        case '"':
+            return string_value(nullptr);
+        case 't':
+            return literal("true");
+        case 'f':
+            return literal("false");
+        case 'n':
+            return literal("null");
+        default:
+            return number_literal();
+        }
+    }
+
+    /**
+     * Only whitespace is allowed after the document
+     */
+    bool finished() {
+        skip_whitespace();
+        return p_ == end_;
+    }
+
+private:
+    void skip_whitespace() {
+        while (p_ < end_ && (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t')) {
+            ++p_;
+        }
+    }
+
+    char peek() {
+        skip_whitespace();
+        return p_ < end_ ? *p_ : '\0';
+    }
+
+    bool consume(char c) {
+        if (peek() != c) {
+            return false;
+        }
+        ++p_;
+        return true;
+    }
+
+    bool literal(const char *word) {
+        size_t size = strlen(word);
+        if (static_cast<size_t>(end_ - p_) < size || memcmp(p_, word, size) != 0) {
+            return false;
+        }
+        p_ += size;
+        return true;
+    }
+
+    bool number_literal() {
+        const char *start = p_;
+        while (p_ < end_ && (strchr("+-.eE", *p_) || (*p_ >= '0' && *p_ <= '9'))) {
+            ++p_;
+        }
+        return p_ != start;
+    }
+
+    static unsigned int to_unsigned(const char *start, const char *end) {
+        unsigned int value = 0;
+        const char *p = start;
+        while (p < end && *p >= '0' && *p <= '9') {
+            value = value * 10 + (*p - '0');
+            ++p;
+        }
+        // Fractions are truncated, anything else is not a number
+        if (p == start || (p < end && *p != '.')) {
+            return 0;
+        }
+        return value;
+    }
+
+    static int hex(char c) {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        }
+        if (c >= 'A' && c <= 'F') {
+            return c - 'A' + 10;
+        }
+        return -1;
+    }
+
+    bool code_unit(unsigned int &unit) {
+        if (end_ - p_ < 4) {
+            return false;
+        }
+        unit = 0;
+        for (int i = 0; i < 4; ++i) {
+            int digit = hex(*p_++);
+            if (digit < 0) {
+                return false;
+            }
+            unit = unit << 4 | digit;
+        }
+        return true;
+    }
+
+    /**
+     * Decode the escape after a backslash into out, which has room for 4
+     * bytes. Returns the number of bytes, 0 on malformed input.
+     *
+     * The decoded bytes are never more than the escape.
+     */
+    size_t escape(char *out) {
+        if (p_ == end_) {
+            return 0;
+        }
+        char escape = *p_++;
+        if (escape == 'u') {
+            unsigned int cp;
+            if (!code_unit(cp)) {
+                return 0;
+            }
+            // Join surrogate pairs, lone surrogates are replaced. An escape
+            // which doesn't complete the pair is left for the next call.
+            if (cp >= 0xD800 && cp <= 0xDBFF) {
+                const char *next = p_;
+                unsigned int low = 0;
+                if (end_ - p_ >= 6 && p_[0] == '\\' && p_[1] == 'u') {
+                    p_ += 2;
+                    if (!code_unit(low)) {
+                        return 0;
+                    }
+                }
+                if (next != p_ && low >= 0xDC00 && low <= 0xDFFF) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                } else {
+                    p_ = next;
+                    cp = 0xFFFD;
+                }
+            } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                cp = 0xFFFD;
+            }
+            return Ingest::encode(out, cp);
+        }
+
+        switch (escape) {
+        case '"':
+        case '\\':
+        case '/':
+            out[0] = escape;
+            break;
+        case 'b':
+            out[0] = '\b';
+            break;
+        case 'f':
+            out[0] = '\f';
+            break;
+        case 'n':
+            out[0] = '\n';
+            break;
+        case 'r':
+            out[0] = '\r';
+            break;
+        case 't':
+            out[0] = '\t';
+            break;
+        default:
+            return 0;
+        }
+        return 1;
+    }
+
+    /**
+     * Read a string, decoding the escapes into out (if not nullptr)
+     */
+    bool string_value(string *out) {
+        if (p_ == end_ || *p_ != '"') {
+            return false;
+        }
+        ++p_;
+        if (out) {
+            out->clear();
+        }
+
+        for (;;) {
+            // Copy plain runs of characters at once
+            const char *start = p_;
+            while (p_ < end_ && *p_ != '"' && *p_ != '\\') {
+                ++p_;
+            }
+            if (out) {
+                out->append(start, p_ - start);
+            }
+            if (p_ == end_) {
+                return false;
+            }
+            if (*p_++ == '"') {
+                return true;
+            }
+
+            char decoded[4];
+            size_t size = escape(decoded);
+            if (size == 0) {
+                return false;
+            }
+            if (out) {
+                out->append(decoded, size);
+            }
+        }
+    }
+
+    /**
+     * Read a string of a document we own, decoding the escapes over the
+     * document itself: the decoded text only overwrites what has already been
+     * read, as it's never longer
+     */
+    bool string_in_place(boost::string_ref &out) {
+        if (p_ == end_ || *p_ != '"') {
+            return false;
+        }
+        ++p_;
+
+        char *text = writable(p_);
+        char *w = text;
+        for (;;) {
+            const char *start = p_;
+            while (p_ < end_ && *p_ != '"' && *p_ != '\\') {
+                ++p_;
+            }
+            // Until the first escape, the text is already where it belongs
+            size_t size = p_ - start;
+            if (w != writable(start)) {
+                memmove(w, start, size);
+            }
+            w += size;
+            if (p_ == end_) {
+                return false;
+            }
+            if (*p_++ == '"') {
+                out = boost::string_ref(text, w - text);
+                return true;
+            }
+
+            char decoded[4];
+            size = escape(decoded);
+            if (size == 0) {
+                return false;
+            }
+            memcpy(w, decoded, size);
+            w += size;
+        }
+    }
+
+    /**
+     * The text between start and the current position, a view into the
+     * document if we own it, otherwise a copy in the arena
+     */
+    boost::string_ref keep(const char *start) {
+        if (document_) {
+            return boost::string_ref(writable(start), p_ - start);
+        }
+        return arena_.store(start, p_ - start);
+    }
+
+    char *writable(const char *p) {
+        return document_ + (p - data_);
+    }
+
+    const char *data_;
+    const char *p_;
+    const char *end_;
+
+    /**
+     * Where the text of the results goes
+     */
+    Arena &arena_;
+
+    /**
+     * The document, if it's ours to overwrite
+     */
+    char *document_;
+
+    /**
+     * Reused buffers, to avoid an allocation for each key and value
+     */
+    string key_;
+    string scratch_;
+};
+
+bool decode_result(Reader &reader, Client::Result &result) {
+    if (!reader.is_object()) {
+        return reader.skip();
+    }
+    return reader.object([&reader, &result](const string &key) {
+        if (key == "Result") {
+            return reader.text(result.result);
+        } else if (key == "FirstURL") {
+            return reader.text(result.url);
+        } else if (key == "Text") {
+            return reader.text(result.text);
+        } else if (key == "Icon" && reader.is_object()) {
+            return reader.object([&reader, &result](const string &key) {
+                if (key == "URL") {
+                    return reader.text(result.icon.url);
+                } else if (key == "Width") {
+                    return reader.number(result.icon.width);
+                } else if (key == "Height") {
+                    return reader.number(result.icon.height);
+                }
+                return reader.skip();
+            });
+        }
+        return reader.skip();
+    });
+}
+
+bool decode_content(Reader &reader, Client::Content &content) {
+    if (!reader.is_object()) {
+        return reader.skip();
+    }
+    return reader.object([&reader, &content](const string &key) {
+        if (key == "data_type") {
+            return reader.text(content.data_type);
+        } else if (key == "value") {
+            return reader.text(content.value);
+        } else if (key == "label") {
+            return reader.text(content.label);
+        } else if (key == "wiki_order") {
+            return reader.number(content.wiki_order);
+        }
+        return reader.skip();
+    });
+}
+
+bool decode_infobox(Reader &reader, Client::Infobox &infobox) {
+    // When there is no infobox, DuckDuckGo sends an empty string
+    if (!reader.is_object()) {
+        return reader.skip();
+    }
+    return reader.object([&reader, &infobox](const string &key) {
+        if (key != "content" || !reader.is_array()) {
+            return reader.skip();
+        }
+        return reader.array([&reader, &infobox]() {
+            infobox.emplace_back(Client::Content { {}, {}, {}, 0 });
+            return decode_content(reader, infobox.back());
+        });
+    });
+}
+
+bool decode_topics(Reader &reader, Client::RelatedTopics &topics) {
+    if (!reader.is_array()) {
+        return reader.skip();
+    }
+    return reader.array([&reader, &topics]() {
+        topics.emplace_back(Client::Result { {}, {}, Client::Icon { {}, 0, 0 }, {} });
+        return decode_result(reader, topics.back());
+    });
+}
+
+bool decode_document(Reader &reader, Client::QueryResults &results) {
+    bool ok = reader.is_object() && reader.object([&reader, &results](const string &key) {
+        // Most keys are short, compare the first character before the rest
+        switch (key.empty() ? '\0' : key[0]) {
+        case 'A':
+            if (key == "Abstract") {
+                return reader.text(results.abstract.summary);
+            } else if (key == "AbstractText") {
+                return reader.text(results.abstract.textSummary);
+            } else if (key == "AbstractSource") {
+                return reader.text(results.abstract.source);
+            } else if (key == "AbstractURL") {
+                return reader.text(results.abstract.url);
+            } else if (key == "Answer") {
+                return reader.text(results.answer.instantAnswer);
+            } else if (key == "AnswerType") {
+                return reader.text(results.answer.type);
+            }
+            break;
+        case 'D':
+            if (key == "Definition") {
+                return reader.text(results.definition.definition);
+            } else if (key == "DefinitionSource") {
+                return reader.text(results.definition.source);
+            } else if (key == "DefinitionURL") {
+                return reader.text(results.definition.url);
+            }
+            break;
+        case 'H':
+            if (key == "Heading") {
+                return reader.text(results.abstract.heading);
+            }
+            break;
+        case 'I':
+            if (key == "Image") {
+                return reader.text(results.abstract.imageUrl);
+            } else if (key == "Infobox") {
+                return decode_infobox(reader, results.infobox);
+            }
+            break;
+        case 'R':
+            if (key == "RelatedTopics") {
+                return decode_topics(reader, results.relatedTopics);
+            }
+            break;
+        case 'T':
+            if (key == "Type") {
+                return reader.text(results.type);
+            }
+            break;
+        }
+        return reader.skip();
+    }) && reader.finished();
+
+    // Like an invalid document, don't trust anything we read from it
+    if (!ok) {
+        results = Client::QueryResults();
+    }
+    return ok;
+}
+
+}
+
+bool Decoder::decode(const char *data, size_t size, Client::QueryResults &results) {
+    // Decoded text is never longer than the document, so a single block
+    // holds all of it
+    results.arena.reserve(size);
+    Reader reader(data, size, results.arena);
+    return decode_document(reader, results);
+}
+
+bool Decoder::decode(string &&document, Client::QueryResults &results) {
+    string &owned = results.arena.adopt(move(document));
+    Reader reader(owned.data(), owned.size(), results.arena, &owned[0]);
+    return decode_document(reader, results);
+}
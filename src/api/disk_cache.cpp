@@ -0,0 +1,638 @@
+#include <api/disk_cache.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace api;
+using namespace std;
+
+namespace {
+
+/**
+ * "DDC2": the first record of a log written in a different format is
+ * invalid, and the whole log is dropped
+ */
+const uint32_t MAGIC = 0x32434444;
+
+/**
+ * Don't bother compacting logs smaller than this
+ */
+const uint64_t COMPACT_THRESHOLD = 64 * 1024;
+
+/**
+ * The log file grows ahead of the appends by at least this much
+ */
+const uint64_t RESERVE_CHUNK = 64 * 1024;
+
+struct Header {
+    uint32_t magic;
+    uint32_t key_size;
+    uint32_t value_size;
+    uint32_t checksum;
+    int64_t stored;
+};
+
+/**
+ * FNV-1a of the key and value of a record. The file is zeroed past the
+ * log, so the size in a torn header can't tell whether the rest made it.
+ */
+uint32_t checksum(const char *data, size_t size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619u;
+    }
+    return hash;
+}
+
+int64_t now() {
+    return chrono::duration_cast<chrono::seconds>(
+            chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Append the fields of the results to a buffer, strings are prefixed by
+ * their size
+ */
+class Writer {
+public:
+    explicit Writer(vector<char> &buffer) :
+        buffer_(buffer) {
+    }
+
+    void u32(uint32_t value) {
+        const char *p = reinterpret_cast<const char *>(&value);
+        buffer_.insert(buffer_.end(), p, p + sizeof(value));
+    }
+
+    void str(boost::string_ref value) {
+        u32(value.size());
+        buffer_.insert(buffer_.end(), value.begin(), value.end());
+    }
+
+    void result(const Client::Result &r) {
+        str(r.result);
+        str(r.url);
+        str(r.icon.url);
+        u32(r.icon.width);
+        u32(r.icon.height);
+        str(r.text);
+    }
+
+private:
+    vector<char> &buffer_;
+};
+
+/**
+ * Read back what Writer wrote, failing on truncated input. Strings are
+ * stored in the arena of the results.
+ */
+class Reader {
+public:
+    Reader(const char *data, size_t size, Arena &arena) :
+        p_(data), end_(data + size), arena_(arena) {
+    }
+
+    bool u32(uint32_t &value) {
+        if (end_ - p_ < static_cast<ptrdiff_t>(sizeof(value))) {
+            return false;
+        }
+        memcpy(&value, p_, sizeof(value));
+        p_ += sizeof(value);
+        return true;
+    }
+
+    bool str(boost::string_ref &value) {
+        uint32_t size;
+        if (!u32(size) || end_ - p_ < static_cast<ptrdiff_t>(size)) {
+            return false;
+        }
+        value = arena_.store(p_, size);
+        p_ += size;
+        return true;
+    }
+
+    bool result(Client::Result &r) {
+        return str(r.result) && str(r.url) && str(r.icon.url) &&
+            u32(r.icon.width) && u32(r.icon.height) && str(r.text);
+    }
+
+private:
+    const char *p_;
+    const char *end_;
+    Arena &arena_;
+};
+
+void serialize(const Client::QueryResults &results, vector<char> &buffer) {
+    Writer w(buffer);
+
+    w.str(results.abstract.summary);
+    w.str(results.abstract.textSummary);
+    w.str(results.abstract.source);
+    w.str(results.abstract.url);
+    w.str(results.abstract.imageUrl);
+    w.str(results.abstract.heading);
+
+    w.str(results.answer.instantAnswer);
+    w.str(results.answer.type);
+
+    w.str(results.definition.definition);
+    w.str(results.definition.source);
+    w.str(results.definition.url);
+
+    w.str(results.type);
+
+    w.u32(results.infobox.size());
+    for (const auto &content : results.infobox) {
+        w.str(content.data_type);
+        w.str(content.value);
+        w.str(content.label);
+        w.u32(content.wiki_order);
+    }
+
+    w.u32(results.relatedTopics.size());
+    for (const auto &r : results.relatedTopics) {
+        w.result(r);
+    }
+
+    w.u32(results.results.size());
+    for (const auto &r : results.results) {
+        w.result(r);
+    }
+}
+
+bool deserialize(const char *data, size_t size, Client::QueryResults &results) {
+    // The strings are a part of the record, so they fit in a single block
+    results.arena.reserve(size);
+    Reader r(data, size, results.arena);
+
+    if (!(r.str(results.abstract.summary) &&
+          r.str(results.abstract.textSummary) &&
+          r.str(results.abstract.source) &&
+          r.str(results.abstract.url) &&
+          r.str(results.abstract.imageUrl) &&
+          r.str(results.abstract.heading) &&
+          r.str(results.answer.instantAnswer) &&
+          r.str(results.answer.type) &&
+          r.str(results.definition.definition) &&
+          r.str(results.definition.source) &&
+          r.str(results.definition.url) &&
+          r.str(results.type))) {
+        return false;
+    }
+
+    uint32_t count;
+    if (!r.u32(count)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        Client::Content content;
+        if (!(r.str(content.data_type) && r.str(content.value) &&
+              r.str(content.label) && r.u32(content.wiki_order))) {
+            return false;
+        }
+        results.infobox.emplace_back(move(content));
+    }
+
+    if (!r.u32(count)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        Client::Result result;
+        if (!r.result(result)) {
+            return false;
+        }
+        results.relatedTopics.emplace_back(move(result));
+    }
+
+    if (!r.u32(count)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        Client::Result result;
+        if (!r.result(result)) {
+            return false;
+        }
+        results.results.emplace_back(move(result));
+    }
+
+    return true;
+}
+
+/**
+ * Write the whole buffer, retrying on short writes
+ */
+bool write_all(int fd, const char *data, size_t size, uint64_t offset) {
+    while (size > 0) {
+        ssize_t written = pwrite(fd, data, size, offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= written;
+        offset += written;
+    }
+    return true;
+}
+
+/**
+ * Read the whole buffer, failing if the file ends before
+ */
+bool read_all(int fd, char *data, size_t size, uint64_t offset) {
+    while (size > 0) {
+        ssize_t read = pread(fd, data, size, offset);
+        if (read < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (read == 0) {
+            return false;
+        }
+        data += read;
+        size -= read;
+        offset += read;
+    }
+    return true;
+}
+
+}
+
+DiskCache::DiskCache(Config::Ptr config, const string &path) :
+    config_(config), path_(path), opened_(false), fd_(-1), data_(nullptr),
+    mapped_(0), end_(0), live_(0), compact_(false), stopped_(false) {
+}
+
+DiskCache::~DiskCache() {
+    stop();
+    close();
+}
+
+void DiskCache::stop() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        stopped_ = true;
+    }
+    wake_.notify_all();
+
+    if (compactor_.joinable()) {
+        compactor_.join();
+    }
+}
+
+uint64_t DiskCache::size() {
+    lock_guard<mutex> lock(mutex_);
+    return end_;
+}
+
+uint64_t DiskCache::hash(const string &query) const {
+    return std::hash<string>()(query);
+}
+
+bool DiskCache::open() {
+    if (opened_) {
+        return fd_ >= 0;
+    }
+    opened_ = true;
+
+    fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd_ < 0) {
+        return false;
+    }
+
+    scan();
+
+    // Start from a compact log, dropping what expired while we were away
+    schedule();
+    return fd_ >= 0;
+}
+
+void DiskCache::close() {
+    if (data_) {
+        munmap(const_cast<char *>(data_), mapped_);
+        data_ = nullptr;
+        mapped_ = 0;
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+bool DiskCache::map() {
+    if (end_ <= mapped_) {
+        return true;
+    }
+    return remap(end_);
+}
+
+bool DiskCache::remap(uint64_t size) {
+    if (data_) {
+        munmap(const_cast<char *>(data_), mapped_);
+        data_ = nullptr;
+        mapped_ = 0;
+    }
+    if (size == 0) {
+        return true;
+    }
+
+    void *data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd_, 0);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    data_ = static_cast<const char *>(data);
+    mapped_ = size;
+    return true;
+}
+
+bool DiskCache::reserve(uint64_t size) {
+    if (size <= mapped_) {
+        return true;
+    }
+
+    // Mapping the log again on each append would cost as much as the log:
+    // it grows by doubling, and the appends go in the room left
+    uint64_t reserved = max(size, max(mapped_ * 2, RESERVE_CHUNK));
+    if (ftruncate(fd_, reserved) != 0) {
+        return false;
+    }
+    return remap(reserved);
+}
+
+uint64_t DiskCache::size_of(uint64_t offset) const {
+    Header header;
+    memcpy(&header, data_ + offset, sizeof(header));
+    return sizeof(header) + header.key_size + header.value_size;
+}
+
+bool DiskCache::owns(const Slot &slot, const string &query) const {
+    Header header;
+    memcpy(&header, data_ + slot.offset, sizeof(header));
+    return query.compare(0, string::npos, data_ + slot.offset + sizeof(header),
+                         header.key_size) == 0;
+}
+
+void DiskCache::scan() {
+    index_.clear();
+    live_ = 0;
+    end_ = 0;
+
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+        return;
+    }
+    end_ = st.st_size;
+    if (end_ == 0 || !map()) {
+        end_ = 0;
+        return;
+    }
+
+    // Walk the records, building the index of the latest one for each query
+    uint64_t offset = 0;
+    while (offset + sizeof(Header) <= mapped_) {
+        Header header;
+        memcpy(&header, data_ + offset, sizeof(header));
+        uint64_t size = sizeof(header) + header.key_size + header.value_size;
+        if (header.magic != MAGIC || offset + size > mapped_ ||
+                checksum(data_ + offset + sizeof(header), size - sizeof(header))
+                    != header.checksum) {
+            break;
+        }
+
+        string query(data_ + offset + sizeof(header), header.key_size);
+        auto slot = index_.find(hash(query));
+        if (slot != index_.end()) {
+            // Another query with the same hash keeps its place
+            if (!owns(slot->second, query)) {
+                offset += size;
+                continue;
+            }
+            live_ -= size_of(slot->second.offset);
+        }
+        if (expired(header.stored)) {
+            if (slot != index_.end()) {
+                index_.erase(slot);
+            }
+        } else {
+            index_[hash(query)] = Slot { offset, header.stored };
+            live_ += size;
+        }
+
+        offset += size;
+    }
+
+    // Drop a record torn by a crash in the middle of an append, and the room
+    // reserved for the next ones
+    if (offset < end_) {
+        end_ = offset;
+        if (ftruncate(fd_, end_) != 0 || !remap(end_)) {
+            close();
+            end_ = 0;
+            return;
+        }
+    }
+}
+
+bool DiskCache::bloated() const {
+    // More dead than live records, or too large
+    return end_ > COMPACT_THRESHOLD &&
+        (end_ - live_ > live_ || end_ > config_->disk_cache_size);
+}
+
+void DiskCache::schedule() {
+    if (stopped_ || !bloated()) {
+        return;
+    }
+
+    // The searches don't wait for the disk: the log is compacted on a
+    // thread of its own
+    compact_ = true;
+    if (!compactor_.joinable()) {
+        compactor_ = thread(&DiskCache::run, this);
+    }
+    wake_.notify_one();
+}
+
+void DiskCache::run() {
+    unique_lock<mutex> lock(mutex_);
+    for (;;) {
+        wake_.wait(lock, [this]() {
+            return stopped_ || compact_;
+        });
+        if (stopped_) {
+            return;
+        }
+        compact_ = false;
+        if (bloated()) {
+            compact(lock);
+        }
+    }
+}
+
+void DiskCache::compact(unique_lock<mutex> &lock) {
+    if (fd_ < 0 || !map()) {
+        return;
+    }
+
+    // Pick the live records, oldest first so the newest survive a size cap
+    vector<Slot> slots;
+    slots.reserve(index_.size());
+    for (const auto &slot : index_) {
+        if (!expired(slot.second.stored)) {
+            slots.push_back(slot.second);
+        }
+    }
+    sort(slots.begin(), slots.end(), [](const Slot &a, const Slot &b) {
+        return a.offset < b.offset;
+    });
+
+    vector<pair<uint64_t, uint64_t>> records;
+    uint64_t total = 0;
+    for (const auto &slot : slots) {
+        total += size_of(slot.offset);
+    }
+    for (const auto &slot : slots) {
+        uint64_t size = size_of(slot.offset);
+        if (total > config_->disk_cache_size) {
+            total -= size;
+            continue;
+        }
+        records.emplace_back(slot.offset, size);
+    }
+
+    // The records are never rewritten, only appended: they can be copied
+    // while the searches go on
+    uint64_t copied = end_;
+    int source = dup(fd_);
+    if (source < 0) {
+        return;
+    }
+    lock.unlock();
+
+    string tmp = path_ + ".tmp";
+    int fd = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    bool ok = fd >= 0;
+    uint64_t offset = 0;
+    vector<char> buffer;
+    for (const auto &record : records) {
+        if (!ok) {
+            break;
+        }
+        buffer.resize(record.second);
+        ok = read_all(source, buffer.data(), buffer.size(), record.first) &&
+            write_all(fd, buffer.data(), buffer.size(), offset);
+        offset += record.second;
+    }
+    ::close(source);
+
+    lock.lock();
+
+    // Then the records appended in the meantime, which are newer than all
+    // the others
+    ok = ok && !stopped_ && fd_ >= 0 && map() &&
+        write_all(fd, data_ + copied, end_ - copied, offset);
+
+    // The new log must be on disk before it takes the place of the old one
+    ok = ok && fsync(fd) == 0;
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    if (!ok || rename(tmp.c_str(), path_.c_str()) != 0) {
+        unlink(tmp.c_str());
+        return;
+    }
+
+    // Start again from the compacted log
+    close();
+    fd_ = ::open(path_.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd_ >= 0) {
+        scan();
+    }
+}
+
+bool DiskCache::expired(int64_t stored) const {
+    return now() - stored > config_->disk_cache_ttl.count();
+}
+
+shared_ptr<const Client::QueryResults> DiskCache::get(const string &query,
+                                                      bool stale) {
+    lock_guard<mutex> lock(mutex_);
+
+    if (!open()) {
+        return nullptr;
+    }
+
+    auto slot = index_.find(hash(query));
+    if (slot == index_.end() || (!stale && expired(slot->second.stored)) ||
+            !map()) {
+        return nullptr;
+    }
+
+    // Two queries may share the same hash
+    if (!owns(slot->second, query)) {
+        return nullptr;
+    }
+
+    Header header;
+    memcpy(&header, data_ + slot->second.offset, sizeof(header));
+    const char *value = data_ + slot->second.offset + sizeof(header) +
+        header.key_size;
+
+    auto results = make_shared<Client::QueryResults>();
+    if (!deserialize(value, header.value_size, *results)) {
+        return nullptr;
+    }
+    return results;
+}
+
+void DiskCache::put(const string &query, const Client::QueryResults &results) {
+    lock_guard<mutex> lock(mutex_);
+
+    if (!open() || !map()) {
+        return;
+    }
+
+    // The first query with a hash keeps its place, until it expires
+    auto slot = index_.find(hash(query));
+    if (slot != index_.end() && !owns(slot->second, query) &&
+            !expired(slot->second.stored)) {
+        return;
+    }
+
+    vector<char> record(sizeof(Header));
+    record.insert(record.end(), query.begin(), query.end());
+    serialize(results, record);
+
+    Header header { MAGIC, static_cast<uint32_t>(query.size()),
+        static_cast<uint32_t>(record.size() - sizeof(Header) - query.size()),
+        checksum(record.data() + sizeof(Header), record.size() - sizeof(Header)),
+        now() };
+    memcpy(record.data(), &header, sizeof(header));
+
+    if (!reserve(end_ + record.size()) ||
+            !write_all(fd_, record.data(), record.size(), end_)) {
+        return;
+    }
+
+    if (slot != index_.end()) {
+        live_ -= size_of(slot->second.offset);
+    }
+    index_[hash(query)] = Slot { end_, header.stored };
+    end_ += record.size();
+    live_ += record.size();
+
+    schedule();
+}
@@ -0,0 +1,67 @@
+#include <api/histogram.h>
+
+#include <cmath>
+
+using namespace api;
+using namespace std;
+
+const size_t Histogram::BUCKETS;
+
+Histogram::Histogram() :
+    count_(0), sum_(0) {
+    for (auto &bucket : buckets_) {
+        bucket.store(0, memory_order_relaxed);
+    }
+}
+
+void Histogram::record(chrono::microseconds duration) {
+    uint64_t us = duration.count() > 0 ? duration.count() : 0;
+
+    // The smallest i with us <= 2^i
+    size_t i = 0;
+    while (i < BUCKETS - 1 && (uint64_t(1) << i) < us) {
+        ++i;
+    }
+
+    buckets_[i].fetch_add(1, memory_order_relaxed);
+    count_.fetch_add(1, memory_order_relaxed);
+    sum_.fetch_add(us, memory_order_relaxed);
+}
+
+uint64_t Histogram::count() const {
+    return count_.load(memory_order_relaxed);
+}
+
+chrono::microseconds Histogram::sum() const {
+    return chrono::microseconds(sum_.load(memory_order_relaxed));
+}
+
+uint64_t Histogram::bucket(size_t i) const {
+    return buckets_[i].load(memory_order_relaxed);
+}
+
+chrono::microseconds Histogram::upper_bound(size_t i) {
+    return chrono::microseconds(uint64_t(1) << i);
+}
+
+chrono::microseconds Histogram::percentile(double q) const {
+    uint64_t total = 0;
+    uint64_t counts[BUCKETS];
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        counts[i] = bucket(i);
+        total += counts[i];
+    }
+    if (total == 0) {
+        return chrono::microseconds(0);
+    }
+
+    uint64_t rank = static_cast<uint64_t>(ceil(q * total));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        seen += counts[i];
+        if (seen >= rank && counts[i] > 0) {
+            return upper_bound(i);
+        }
+    }
+    return upper_bound(BUCKETS - 1);
+}
@@ -0,0 +1,312 @@
+#include <api/http_pool.h>
+
+#include <core/net/error.h>
+#include <core/net/http/client.h>
+
+#include <algorithm>
+#include <future>
+#include <vector>
+
+namespace http = core::net::http;
+namespace net = core::net;
+
+using namespace api;
+using namespace std;
+
+namespace {
+
+/**
+ * Connections are kept per scheme, host and port
+ */
+string host_of(const string &uri) {
+    size_t start = uri.find("://");
+    start = start == string::npos ? 0 : start + 3;
+    return uri.substr(0, uri.find('/', start));
+}
+
+}
+
+HttpPool::HttpPool(Config::Ptr config) :
+    config_(config), client_(http::make_client()), hedge_budget_(1),
+    stopped_(false), waited_(0), hedged_(0), hedge_wins_(0) {
+    // The event loop of the client drives all the asynchronous requests
+    worker_ = thread([this]() {
+        client_->run();
+    });
+}
+
+HttpPool::~HttpPool() {
+    stop();
+}
+
+void HttpPool::stop() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        if (stopped_.exchange(true)) {
+            return;
+        }
+
+        // Wake up whoever waits on a request the event loop won't finish
+        for (const auto &call : calls_) {
+            if (!call->settled.exchange(true)) {
+                call->done.set_exception(make_exception_ptr(
+                        net::Error("HTTP pool has been stopped")));
+            }
+        }
+    }
+    wake();
+
+    client_->stop();
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+string HttpPool::uri_to_string(const net::Uri &uri) const {
+    return client_->uri_to_string(uri);
+}
+
+uint64_t HttpPool::waited() const {
+    return waited_;
+}
+
+uint64_t HttpPool::hedged() const {
+    return hedged_;
+}
+
+uint64_t HttpPool::hedge_wins() const {
+    return hedge_wins_;
+}
+
+void HttpPool::wake() {
+    lock_guard<mutex> lock(mutex_);
+    for (auto &host : hosts_) {
+        host.second.available.notify_all();
+    }
+}
+
+void HttpPool::acquire(const string &host,
+                       chrono::steady_clock::time_point deadline,
+                       const atomic<bool> *cancelled) {
+    unique_lock<mutex> lock(mutex_);
+    Host &h = hosts_[host];
+
+    // Cap the connections we keep busy against a single host. A search
+    // doesn't wait past its budget for the slow requests of others.
+    auto room = [this, &h, cancelled]() {
+        return stopped_ || (cancelled && *cancelled) ||
+                h.active < config_->max_connections_per_host;
+    };
+    if (!room()) {
+        ++waited_;
+        if (deadline == chrono::steady_clock::time_point::max()) {
+            h.available.wait(lock, room);
+        } else if (!h.available.wait_until(lock, deadline, room)) {
+            throw net::Error("Request timed out");
+        }
+    }
+    if (stopped_) {
+        throw net::Error("HTTP pool has been stopped");
+    }
+    if (cancelled && *cancelled) {
+        // We may have been woken up for a connection, pass it on
+        if (h.active < config_->max_connections_per_host) {
+            h.available.notify_one();
+        }
+        throw net::Error("Request cancelled");
+    }
+    ++h.active;
+}
+
+void HttpPool::release(const string &host) {
+    lock_guard<mutex> lock(mutex_);
+    Host &h = hosts_[host];
+    --h.active;
+
+    // Only the requests to this host wait for its connections
+    h.available.notify_one();
+}
+
+bool HttpPool::acquire_hedge(const string &host) {
+    lock_guard<mutex> lock(mutex_);
+    Host &h = hosts_[host];
+    if (stopped_ || hedge_budget_ < 1 ||
+            h.active >= config_->max_connections_per_host) {
+        return false;
+    }
+    hedge_budget_ -= 1;
+    ++h.active;
+    return true;
+}
+
+chrono::microseconds HttpPool::hedge_after(const string &endpoint) {
+    lock_guard<mutex> lock(mutex_);
+
+    // Every request earns a share of a hedge, and the unused ones don't pile
+    // up to a burst
+    hedge_budget_ = min(hedge_budget_ + config_->hedge_rate, 1.0 +
+                        config_->hedge_rate * config_->hedge_window);
+
+    return endpoints_[endpoint].hedge_after;
+}
+
+void HttpPool::record(const string &endpoint, chrono::microseconds latency) {
+    lock_guard<mutex> lock(mutex_);
+    Endpoint &e = endpoints_[endpoint];
+
+    // The oldest latency makes room for the newest one
+    if (e.samples.size() < config_->hedge_window) {
+        e.samples.push_back(latency);
+    } else {
+        e.samples[e.next] = latency;
+        e.next = (e.next + 1) % e.samples.size();
+    }
+    if (e.samples.size() < config_->hedge_min_samples) {
+        return;
+    }
+
+    vector<chrono::microseconds> sorted(e.samples);
+    auto nth = sorted.begin() + static_cast<size_t>(
+            config_->hedge_percentile * (sorted.size() - 1));
+    nth_element(sorted.begin(), nth, sorted.end());
+    e.hedge_after = *nth;
+}
+
+http::Response HttpPool::execute(const http::Request::Configuration &configuration,
+                                 const http::Request::ProgressHandler &progress,
+                                 chrono::steady_clock::time_point deadline,
+                                 const string &endpoint,
+                                 const atomic<bool> *cancelled) {
+    string host = host_of(configuration.uri);
+    acquire(host, deadline, cancelled);
+
+    // Give the slots back however the request ends
+    struct Slot {
+        HttpPool *pool;
+        const string &host;
+        bool taken;
+        ~Slot() {
+            if (taken) {
+                pool->release(host);
+            }
+        }
+    } slot { this, host, true }, hedge_slot { this, host, false };
+
+    // The handlers may outlive this call if the event loop is slow to notice
+    // an abort, so they only share the call
+    auto call = make_shared<Call>();
+    struct Registration {
+        HttpPool *pool;
+        Call::Ptr call;
+        ~Registration() {
+            lock_guard<mutex> lock(pool->mutex_);
+            pool->calls_.erase(call);
+        }
+    };
+    {
+        lock_guard<mutex> lock(mutex_);
+        if (stopped_) {
+            throw net::Error("HTTP pool has been stopped");
+        }
+        calls_.insert(call);
+    }
+    Registration registration { this, call };
+
+    auto send = [&](bool hedge) {
+        ++call->pending;
+        auto request = client_->head(configuration);
+        if (deadline != chrono::steady_clock::time_point::max()) {
+            auto left = deadline - chrono::steady_clock::now();
+            request->set_timeout(
+                    max(chrono::duration_cast<chrono::milliseconds>(left),
+                        chrono::milliseconds(1)));
+        }
+        request->async_execute(
+                    http::Request::Handler()
+                    // The loser is aborted as soon as the winner is in. The
+                    // caller's handler may still run once we gave up, as the
+                    // check races with the abort: it owns its state.
+                    .on_progress([progress, call](const http::Request::Progress &p) {
+                        return call->settled ?
+                                    http::Request::Progress::Next::abort_operation :
+                                    progress(p);
+                    })
+                    .on_response([call, hedge](const http::Response &response) {
+                        if (!call->settled.exchange(true)) {
+                            call->hedge_won = hedge;
+                            call->done.set_value(response);
+                        }
+                    })
+                    .on_error([call](const net::Error &e) {
+                        if (--call->pending == 0 && !call->settled.exchange(true)) {
+                            call->done.set_exception(make_exception_ptr(e));
+                        }
+                    }));
+    };
+
+    auto started = chrono::steady_clock::now();
+    auto hedge_at = chrono::steady_clock::time_point::max();
+    auto hedged_at = started;
+    if (!endpoint.empty()) {
+        auto after = hedge_after(endpoint);
+        if (after != chrono::microseconds::max()) {
+            hedge_at = started + after;
+        }
+    }
+    send(false);
+
+    // Sleep until the response, #stop, the hedge or the deadline: the event
+    // loop may be slow to notice the timeout
+    auto response = call->done.get_future();
+    for (;;) {
+        auto wake = min(deadline, hedge_at);
+        if (wake == chrono::steady_clock::time_point::max()) {
+            response.wait();
+            break;
+        }
+        if (response.wait_until(wake) == future_status::ready) {
+            break;
+        }
+
+        // The callbacks of the caller must not be called after we return
+        auto now = chrono::steady_clock::now();
+        if (now >= deadline) {
+            if (call->settled.exchange(true)) {
+                // The response made it in the meantime
+                break;
+            }
+            throw net::Error("Request timed out");
+        }
+
+        // Slower than most of the recent requests: it's likely stuck on a
+        // bad connection or a slow backend, a duplicate may well overtake it
+        if (now >= hedge_at) {
+            hedge_at = chrono::steady_clock::time_point::max();
+            if (!call->settled && acquire_hedge(host)) {
+                hedge_slot.taken = true;
+                ++hedged_;
+                hedged_at = now;
+                send(true);
+            }
+        }
+    }
+
+    // Failures tell nothing about the latency of the endpoint
+    http::Response result = response.get();
+    auto now = chrono::steady_clock::now();
+    if (!endpoint.empty()) {
+        // When the duplicate wins, the first attempt took at least as long as
+        // we waited for it: learning only from the winner would pull the
+        // hedge threshold down to the fast requests
+        record(endpoint, chrono::duration_cast<chrono::microseconds>(
+                now - started));
+        if (call->hedge_won) {
+            record(endpoint, chrono::duration_cast<chrono::microseconds>(
+                    now - hedged_at));
+        }
+    }
+    if (call->hedge_won) {
+        ++hedge_wins_;
+    }
+    return result;
+}
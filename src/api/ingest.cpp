@@ -0,0 +1,270 @@
+#include <api/ingest.h>
+
+#include <string>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace api;
+using namespace std;
+
+namespace {
+
+const char REPLACEMENT[] = "\xEF\xBF\xBD";
+
+/**
+ * The named entities found in the responses. They all decode to fewer
+ * bytes than their name.
+ */
+struct Entity {
+    const char *name;
+    unsigned int cp;
+};
+
+const Entity ENTITIES[] = {
+    { "amp", '&' },
+    { "lt", '<' },
+    { "gt", '>' },
+    { "quot", '"' },
+    { "apos", '\'' },
+    { "nbsp", 0xA0 },
+    { "copy", 0xA9 },
+    { "reg", 0xAE },
+    { "deg", 0xB0 },
+    { "middot", 0xB7 },
+    { "laquo", 0xAB },
+    { "raquo", 0xBB },
+    { "ndash", 0x2013 },
+    { "mdash", 0x2014 },
+    { "lsquo", 0x2018 },
+    { "rsquo", 0x2019 },
+    { "ldquo", 0x201C },
+    { "rdquo", 0x201D },
+    { "hellip", 0x2026 },
+};
+
+/**
+ * Longest entity we recognize, "&#x10FFFF;" or "&hellip;"
+ */
+const size_t MAX_ENTITY = 10;
+
+/**
+ * Length of the valid UTF-8 sequence starting at i, 0 if it's invalid:
+ * overlong forms, surrogates and code points past U+10FFFF are refused
+ */
+size_t sequence(boost::string_ref text, size_t i) {
+    unsigned char c = text[i];
+    unsigned char low = 0x80, high = 0xBF;
+    size_t size;
+    if (c >= 0xC2 && c <= 0xDF) {
+        size = 2;
+    } else if (c == 0xE0) {
+        size = 3;
+        low = 0xA0;
+    } else if (c == 0xED) {
+        size = 3;
+        high = 0x9F;
+    } else if (c >= 0xE1 && c <= 0xEF) {
+        size = 3;
+    } else if (c == 0xF0) {
+        size = 4;
+        low = 0x90;
+    } else if (c == 0xF4) {
+        size = 4;
+        high = 0x8F;
+    } else if (c >= 0xF1 && c <= 0xF3) {
+        size = 4;
+    } else {
+        return 0;
+    }
+
+    if (text.size() - i < size) {
+        return 0;
+    }
+    unsigned char second = text[i + 1];
+    if (second < low || second > high) {
+        return 0;
+    }
+    for (size_t k = 2; k < size; ++k) {
+        if ((static_cast<unsigned char>(text[i + k]) & 0xC0) != 0x80) {
+            return 0;
+        }
+    }
+    return size;
+}
+
+/**
+ * Decode the entity starting at i (on the '&') into out, which has room for
+ * 4 bytes. Returns the length of the entity, 0 if it's not one.
+ */
+size_t entity(boost::string_ref text, size_t i, char *out, size_t &size) {
+    boost::string_ref rest = text.substr(i + 1, MAX_ENTITY);
+    size_t end = rest.find(';');
+    if (end == boost::string_ref::npos || end == 0) {
+        return 0;
+    }
+    boost::string_ref name = rest.substr(0, end);
+
+    unsigned int cp = 0;
+    if (name[0] == '#') {
+        bool hex = name.size() > 1 && (name[1] == 'x' || name[1] == 'X');
+        boost::string_ref digits = name.substr(hex ? 2 : 1);
+        if (digits.empty()) {
+            return 0;
+        }
+        for (char c : digits) {
+            unsigned int digit;
+            if (c >= '0' && c <= '9') {
+                digit = c - '0';
+            } else if (hex && c >= 'a' && c <= 'f') {
+                digit = c - 'a' + 10;
+            } else if (hex && c >= 'A' && c <= 'F') {
+                digit = c - 'A' + 10;
+            } else {
+                return 0;
+            }
+            cp = cp * (hex ? 16 : 10) + digit;
+        }
+        // Nothing we could show
+        if (cp == 0 || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+            cp = 0xFFFD;
+        }
+    } else {
+        const Entity *found = nullptr;
+        for (const Entity &e : ENTITIES) {
+            if (name == e.name) {
+                found = &e;
+                break;
+            }
+        }
+        if (!found) {
+            return 0;
+        }
+        cp = found->cp;
+    }
+
+    size = Ingest::encode(out, cp);
+    return end + 2;
+}
+
+/**
+ * Replace invalid UTF-8, and decode the entities if asked to
+ */
+boost::string_ref rewrite(boost::string_ref text, Arena &arena, bool entities) {
+    size_t i = Ingest::plain(text);
+    if (i == text.size()) {
+        return text;
+    }
+
+    // Built only once something changes: text before copied is in it
+    string out;
+    size_t copied = 0;
+    auto replace = [&out, &copied, &text](size_t at, size_t length,
+                                          const char *with, size_t size) {
+        out.append(text.data() + copied, at - copied);
+        out.append(with, size);
+        copied = at + length;
+    };
+
+    while (i < text.size()) {
+        unsigned char c = text[i];
+        if (c == '&') {
+            char decoded[4];
+            size_t size;
+            size_t length = entities ? entity(text, i, decoded, size) : 0;
+            if (length) {
+                replace(i, length, decoded, size);
+                i += length;
+            } else {
+                ++i;
+            }
+        } else if (c >= 0x80) {
+            size_t length = sequence(text, i);
+            if (length) {
+                i += length;
+            } else {
+                replace(i, 1, REPLACEMENT, sizeof(REPLACEMENT) - 1);
+                ++i;
+            }
+        } else {
+            ++i;
+        }
+
+        // Plain runs are skipped a block at a time
+        i += Ingest::plain(text.substr(i));
+    }
+
+    if (copied == 0) {
+        return text;
+    }
+    out.append(text.data() + copied, text.size() - copied);
+    return arena.store(out.data(), out.size());
+}
+
+}
+
+void Ingest::clean(Client::QueryResults &results) {
+    Arena &arena = results.arena;
+    results.for_each_text([&arena](boost::string_ref &field) {
+        field = clean(field, arena);
+    }, [&arena](boost::string_ref &field) {
+        field = validate(field, arena);
+    });
+}
+
+boost::string_ref Ingest::clean(boost::string_ref text, Arena &arena) {
+    return rewrite(text, arena, true);
+}
+
+boost::string_ref Ingest::validate(boost::string_ref text, Arena &arena) {
+    return rewrite(text, arena, false);
+}
+
+size_t Ingest::plain(boost::string_ref text) {
+    const char *begin = text.data();
+    const char *p = begin;
+    const char *end = begin + text.size();
+
+#ifdef __SSE2__
+    // The sign bit of each byte tells non-ASCII bytes, and a comparison the
+    // ampersands
+    const __m128i ampersand = _mm_set1_epi8('&');
+    for (; end - p >= 16; p += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        int mask = _mm_movemask_epi8(chunk) |
+                _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, ampersand));
+        if (mask) {
+            return p - begin + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    for (; p < end; ++p) {
+        if (static_cast<unsigned char>(*p) >= 0x80 || *p == '&') {
+            break;
+        }
+    }
+    return p - begin;
+}
+
+size_t Ingest::encode(char *out, unsigned int cp) {
+    if (cp < 0x80) {
+        out[0] = static_cast<char>(cp);
+        return 1;
+    } else if (cp < 0x800) {
+        out[0] = static_cast<char>(0xC0 | cp >> 6);
+        out[1] = static_cast<char>(0x80 | (cp & 0x3F));
+        return 2;
+    } else if (cp < 0x10000) {
+        out[0] = static_cast<char>(0xE0 | cp >> 12);
+        out[1] = static_cast<char>(0x80 | (cp >> 6 & 0x3F));
+        out[2] = static_cast<char>(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = static_cast<char>(0xF0 | cp >> 18);
+    out[1] = static_cast<char>(0x80 | (cp >> 12 & 0x3F));
+    out[2] = static_cast<char>(0x80 | (cp >> 6 & 0x3F));
+    out[3] = static_cast<char>(0x80 | (cp & 0x3F));
+    return 4;
+}
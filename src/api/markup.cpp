@@ -0,0 +1,132 @@
+#include <api/markup.h>
+
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace api;
+using namespace std;
+
+const size_t Markup::npos;
+
+Markup::Anchor Markup::anchor(boost::string_ref html) {
+    Anchor anchor;
+
+    // Only a link has a title
+    size_t open = html.starts_with("<a") ? find(html, '>', 2) : npos;
+    if (open == npos) {
+        anchor.text = html;
+        return anchor;
+    }
+
+    // The title ends where the link does, and the text goes on from there
+    size_t close = find(html, "</a>", open + 1);
+    if (close == npos) {
+        anchor.title = html.substr(open + 1);
+        return anchor;
+    }
+    anchor.title = html.substr(open + 1, close - open - 1);
+    anchor.text = html.substr(close + 4);
+    return anchor;
+}
+
+Markup::Sunrise Markup::sunrise(boost::string_ref html) {
+    static const boost::string_ref AT("@</span>");
+    static const boost::string_ref END("</div>");
+    static const boost::string_ref TIMES("<span class='suninfo--risebox'>");
+
+    Sunrise sunrise;
+    size_t from = 0;
+
+    size_t at = find(html, AT);
+    if (at != npos) {
+        size_t start = at + AT.size();
+        size_t end = find(html, END, start);
+        if (end != npos) {
+            sunrise.location = html.substr(start, end - start);
+            from = end + END.size();
+        }
+    }
+
+    size_t times = find(html, TIMES, from);
+    if (times != npos) {
+        sunrise.times = html.substr(times);
+    }
+    return sunrise;
+}
+
+size_t Markup::find(boost::string_ref text, char c, size_t from) {
+    if (from >= text.size()) {
+        return npos;
+    }
+    const char *begin = text.data();
+    const char *p = begin + from;
+    const char *end = begin + text.size();
+
+#ifdef __SSE2__
+    // 16 bytes at a time: a bit of mask for each byte equal to c
+    const __m128i target = _mm_set1_epi8(c);
+    for (; end - p >= 16; p += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, target));
+        if (mask) {
+            return p - begin + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    for (; p < end; ++p) {
+        if (*p == c) {
+            return p - begin;
+        }
+    }
+    return npos;
+}
+
+size_t Markup::find(boost::string_ref text, boost::string_ref needle,
+                    size_t from) {
+    size_t n = needle.size();
+    if (n == 0) {
+        return from <= text.size() ? from : npos;
+    }
+    if (n == 1) {
+        return find(text, needle[0], from);
+    }
+    if (from >= text.size() || text.size() - from < n) {
+        return npos;
+    }
+    const char *begin = text.data();
+    const char *p = begin + from;
+    // The last position where the needle fits
+    const char *last = begin + text.size() - n;
+
+#ifdef __SSE2__
+    // Candidates are the positions where both the first and the last byte
+    // match, only they are compared whole
+    const __m128i first_byte = _mm_set1_epi8(needle[0]);
+    const __m128i last_byte = _mm_set1_epi8(needle[n - 1]);
+    for (; last - p >= 15; p += 16) {
+        __m128i head = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i tail = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + n - 1));
+        int mask = _mm_movemask_epi8(_mm_and_si128(
+                _mm_cmpeq_epi8(head, first_byte),
+                _mm_cmpeq_epi8(tail, last_byte)));
+        while (mask) {
+            int i = __builtin_ctz(mask);
+            if (memcmp(p + i + 1, needle.data() + 1, n - 2) == 0) {
+                return p + i - begin;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    for (; p <= last; ++p) {
+        if (*p == needle[0] && memcmp(p + 1, needle.data() + 1, n - 1) == 0) {
+            return p - begin;
+        }
+    }
+    return npos;
+}
@@ -0,0 +1,116 @@
+#include <api/metrics.h>
+
+using namespace api;
+using namespace std;
+
+namespace {
+
+struct CounterField {
+    const char *name;
+    const char *help;
+    Metrics::Counter Metrics::*member;
+};
+
+const CounterField COUNTERS[] = {
+    { "requests_total", "Requests sent to the API",
+      &Metrics::requests },
+    { "request_errors_total", "Requests which failed in the transport",
+      &Metrics::request_errors },
+    { "http_errors_total", "Requests answered with an HTTP error",
+      &Metrics::http_errors },
+    { "second_fetch_sent_total", "Searches which sent the path-form request",
+      &Metrics::second_fetch_sent },
+    { "second_fetch_skipped_total", "Searches which skipped the path-form request",
+      &Metrics::second_fetch_skipped },
+    { "second_fetch_cancelled_total", "Searches cancelled before the path-form request",
+      &Metrics::second_fetch_cancelled },
+    { "degraded_total", "Searches with only part of the responses",
+      &Metrics::degraded },
+    { "searches_total", "Searches run",
+      &Metrics::searches },
+    { "cancellations_total", "Searches cancelled",
+      &Metrics::cancellations },
+    { "errors_total", "Searches which failed",
+      &Metrics::errors },
+    { "memory_cache_hits_total", "Searches answered from memory",
+      &Metrics::memory_cache_hits },
+    { "disk_cache_hits_total", "Searches answered from disk",
+      &Metrics::disk_cache_hits },
+    { "stale_cache_hits_total", "Searches answered with expired results",
+      &Metrics::stale_cache_hits },
+    { "cache_misses_total", "Searches which went to the API",
+      &Metrics::cache_misses },
+    { "prefetches_total", "Likely next searches fetched in background",
+      &Metrics::prefetches },
+    { "prefetch_aborts_total", "Prefetches aborted for a search",
+      &Metrics::prefetch_aborts },
+};
+
+struct HistogramField {
+    const char *name;
+    const char *help;
+    Histogram Metrics::*member;
+};
+
+const HistogramField HISTOGRAMS[] = {
+    { "first_byte_seconds", "From sending a request to its first byte",
+      &Metrics::first_byte },
+    { "transfer_seconds", "From the first to the last byte of a response",
+      &Metrics::transfer },
+    { "decode_seconds", "Decoding of a response",
+      &Metrics::decode },
+    { "merge_seconds", "Merge of the responses of a search",
+      &Metrics::merge },
+    { "render_seconds", "Rendering a section of a search, pushes included",
+      &Metrics::render },
+    { "push_seconds", "Handing a card to the shell",
+      &Metrics::push },
+    { "first_card_seconds", "From the start of a search to its first card",
+      &Metrics::first_card },
+    { "last_card_seconds", "From the start of a search to its last card",
+      &Metrics::last_card },
+};
+
+}
+
+Metrics &Metrics::instance() {
+    static Metrics metrics;
+    return metrics;
+}
+
+void Metrics::write(ostream &out, const char *name, const char *help,
+                    const char *type, uint64_t value) {
+    out << "# HELP ddg_" << name << " " << help << "\n"
+        << "# TYPE ddg_" << name << " " << type << "\n"
+        << "ddg_" << name << " " << value << "\n";
+}
+
+void Metrics::write(ostream &out, const char *name, const char *help,
+                    const Histogram &histogram) {
+    out << "# HELP ddg_" << name << " " << help << "\n"
+        << "# TYPE ddg_" << name << " histogram\n";
+
+    // Prometheus buckets are cumulative, and in seconds: keep all the digits
+    // of the microseconds
+    streamsize precision = out.precision(12);
+    uint64_t count = 0;
+    for (size_t i = 0; i < Histogram::BUCKETS; ++i) {
+        count += histogram.bucket(i);
+        out << "ddg_" << name << "_bucket{le=\""
+            << Histogram::upper_bound(i).count() / 1e6 << "\"} " << count << "\n";
+    }
+    out << "ddg_" << name << "_bucket{le=\"+Inf\"} " << count << "\n"
+        << "ddg_" << name << "_sum " << histogram.sum().count() / 1e6 << "\n"
+        << "ddg_" << name << "_count " << count << "\n";
+    out.precision(precision);
+}
+
+void Metrics::write(ostream &out) const {
+    for (const CounterField &counter : COUNTERS) {
+        write(out, counter.name, counter.help, "counter",
+              (this->*counter.member).load());
+    }
+    for (const HistogramField &histogram : HISTOGRAMS) {
+        write(out, histogram.name, histogram.help, this->*histogram.member);
+    }
+}
@@ -0,0 +1,67 @@
+#include <api/result_cache.h>
+
+using namespace api;
+using namespace std;
+
+ResultCache::ResultCache(Config::Ptr config) :
+    config_(config) {
+}
+
+ResultCache::Entry ResultCache::get(const string &query, bool stale) {
+    lock_guard<mutex> lock(mutex_);
+
+    auto it = index_.find(query);
+    if (it == index_.end()) {
+        return Entry();
+    }
+
+    // The caller will fetch expired results again. They are kept for a while
+    // anyway, in case the API is down.
+    auto age = Clock::now() - it->second->stored;
+    if (age > config_->cache_ttl + config_->cache_stale_ttl) {
+        items_.erase(it->second);
+        index_.erase(it);
+        return Entry();
+    }
+    if (!stale && age > config_->cache_ttl) {
+        return Entry();
+    }
+
+    // Move it in front of the list, it's the most recently used now
+    items_.splice(items_.begin(), items_, it->second);
+    return it->second->results;
+}
+
+void ResultCache::put(const string &query, Entry results) {
+    lock_guard<mutex> lock(mutex_);
+
+    if (config_->cache_size == 0) {
+        return;
+    }
+
+    auto it = index_.find(query);
+    if (it != index_.end()) {
+        items_.erase(it->second);
+        index_.erase(it);
+    }
+
+    items_.push_front(Item { query, results, Clock::now() });
+    index_[query] = items_.begin();
+
+    // Evict the least recently used results
+    while (items_.size() > config_->cache_size) {
+        index_.erase(items_.back().query);
+        items_.pop_back();
+    }
+}
+
+size_t ResultCache::size() {
+    lock_guard<mutex> lock(mutex_);
+    return items_.size();
+}
+
+void ResultCache::clear() {
+    lock_guard<mutex> lock(mutex_);
+    items_.clear();
+    index_.clear();
+}
@@ -0,0 +1,212 @@
+#include <api/single_flight.h>
+
+#include <cctype>
+#include <thread>
+
+using namespace api;
+using namespace std;
+
+SingleFlight::SingleFlight(Config::Ptr config, HttpPool::Ptr pool,
+                           CircuitBreaker::Ptr breaker) :
+    config_(config), pool_(pool), breaker_(breaker), stopped_(false) {
+}
+
+SingleFlight::~SingleFlight() {
+    stop();
+}
+
+string SingleFlight::normalize(const string &query) {
+    string key;
+    key.reserve(query.size());
+
+    bool space = false;
+    for (char c : query) {
+        if (isspace(static_cast<unsigned char>(c))) {
+            space = !key.empty();
+            continue;
+        }
+        if (space) {
+            key += ' ';
+            space = false;
+        }
+        key += tolower(static_cast<unsigned char>(c));
+    }
+    return key;
+}
+
+SingleFlight::Waiter::Ptr SingleFlight::join(const string &query,
+                                             const Fetch &fetch) {
+    reap();
+
+    string key = normalize(query);
+    shared_ptr<Flight> flight;
+    {
+        lock_guard<mutex> lock(mutex_);
+        auto it = flights_.find(key);
+        if (it != flights_.end()) {
+            flight = it->second;
+        } else {
+            flight = make_shared<Flight>();
+            flight->client = make_shared<Client>(config_, pool_, breaker_);
+
+            if (stopped_) {
+                // Nothing runs anymore, the waiters get no results
+                flight->done = true;
+            } else {
+                // The fetch doesn't belong to any of the callers, so it runs
+                // on its own thread: whoever started it may stop waiting
+                // before the others
+                flights_[key] = flight;
+                runners_.emplace_back(Runner { flight, thread(
+                        &SingleFlight::run, this, key, flight, fetch) });
+            }
+        }
+        ++flight->waiters;
+    }
+
+    return make_shared<Waiter>(shared_from_this(), key, flight);
+}
+
+void SingleFlight::stop() {
+    list<Runner> runners;
+    {
+        lock_guard<mutex> lock(mutex_);
+        stopped_ = true;
+        for (const auto &runner : runners_) {
+            runner.flight->client->cancel();
+        }
+        runners.swap(runners_);
+    }
+
+    for (auto &runner : runners) {
+        // The last reference to us may go with a fetch, on its own thread
+        if (runner.thread.get_id() == this_thread::get_id()) {
+            runner.thread.detach();
+        } else {
+            runner.thread.join();
+        }
+    }
+}
+
+void SingleFlight::reap() {
+    list<Runner> over;
+    {
+        lock_guard<mutex> lock(mutex_);
+        for (auto it = runners_.begin(); it != runners_.end();) {
+            auto next = std::next(it);
+            if (it->flight->done) {
+                over.splice(over.end(), runners_, it);
+            }
+            it = next;
+        }
+    }
+
+    // Without the lock: the last references to the fetch go with its thread
+    for (auto &runner : over) {
+        if (runner.thread.get_id() == this_thread::get_id()) {
+            runner.thread.detach();
+        } else {
+            runner.thread.join();
+        }
+    }
+}
+
+void SingleFlight::run(const string &key, shared_ptr<Flight> flight,
+                       Fetch fetch) {
+    // Let the waiters show the first response, while the fetch goes on
+    auto partial = [this, flight](const Client::QueryResults &results) {
+        auto snapshot = make_shared<const Client::QueryResults>(results.copy());
+        {
+            lock_guard<mutex> lock(mutex_);
+            flight->partial = snapshot;
+        }
+        flight->changed.notify_all();
+    };
+
+    Results results;
+    exception_ptr error;
+    try {
+        results = fetch(*flight->client, partial);
+    } catch (...) {
+        error = current_exception();
+    }
+
+    {
+        lock_guard<mutex> lock(mutex_);
+        flight->done = true;
+        flight->results = results;
+        flight->error = error;
+
+        // The next callers will start a new flight
+        auto it = flights_.find(key);
+        if (it != flights_.end() && it->second == flight) {
+            flights_.erase(it);
+        }
+    }
+    flight->changed.notify_all();
+}
+
+SingleFlight::Waiter::Waiter(SingleFlight::Ptr owner, const string &key,
+                             shared_ptr<Flight> flight) :
+    owner_(owner), key_(key), flight_(flight), cancelled_(false) {
+}
+
+SingleFlight::Waiter::~Waiter() {
+    cancel();
+}
+
+SingleFlight::Results SingleFlight::Waiter::wait(const Client::Partial &partial) {
+    unique_lock<mutex> lock(owner_->mutex_);
+
+    Results shown;
+    for (;;) {
+        flight_->changed.wait(lock, [this, &partial, &shown]() {
+            return flight_->done || cancelled_ ||
+                (partial && flight_->partial != shown);
+        });
+        if (flight_->done || cancelled_) {
+            break;
+        }
+
+        // Don't hold the lock while the caller uses the partial results
+        shown = flight_->partial;
+        lock.unlock();
+        partial(*shown);
+        lock.lock();
+    }
+
+    if (cancelled_) {
+        return Results();
+    }
+    if (flight_->error) {
+        rethrow_exception(flight_->error);
+    }
+    return flight_->results;
+}
+
+void SingleFlight::Waiter::cancel() {
+    {
+        lock_guard<mutex> lock(owner_->mutex_);
+        if (cancelled_ || flight_->done) {
+            return;
+        }
+        cancelled_ = true;
+        leave();
+    }
+    flight_->changed.notify_all();
+}
+
+void SingleFlight::Waiter::leave() {
+    if (--flight_->waiters > 0) {
+        return;
+    }
+
+    // Nobody wants these results anymore, abort the requests
+    flight_->client->cancel();
+
+    // And don't let new callers join an aborted fetch
+    auto it = owner_->flights_.find(key_);
+    if (it != owner_->flights_.end() && it->second == flight_) {
+        owner_->flights_.erase(it);
+    }
+}
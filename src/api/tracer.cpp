@@ -0,0 +1,134 @@
+#include <api/tracer.h>
+
+#include <cstdio>
+#include <fstream>
+#include <unistd.h>
+
+using namespace api;
+using namespace std;
+
+namespace {
+
+/**
+ * Small ids are easier to read in the trace viewers than thread::id hashes
+ */
+uint32_t thread_number() {
+    static atomic<uint32_t> threads(0);
+    static thread_local uint32_t number = ++threads;
+    return number;
+}
+
+/**
+ * Our names are literals from the code, but let's not write broken JSON
+ */
+void write_string(ostream &out, const char *s) {
+    out << '"';
+    for (; *s; ++s) {
+        if (*s == '"' || *s == '\\') {
+            out << '\\';
+        }
+        out << *s;
+    }
+    out << '"';
+}
+
+}
+
+Tracer &Tracer::instance() {
+    static Tracer tracer;
+    return tracer;
+}
+
+Tracer::Tracer() :
+    enabled_(false), next_(0), wrapped_(false), dirty_(false) {
+}
+
+void Tracer::enable(const string &path, size_t capacity) {
+    lock_guard<mutex> lock(mutex_);
+    path_ = path;
+    events_.assign(capacity, Event());
+    next_ = 0;
+    wrapped_ = false;
+    dirty_ = true;
+    epoch_ = chrono::steady_clock::now();
+    enabled_ = capacity > 0;
+}
+
+void Tracer::record(const char *name, const char *detail,
+                    chrono::steady_clock::time_point started,
+                    chrono::steady_clock::time_point finished) {
+    uint32_t thread = thread_number();
+
+    lock_guard<mutex> lock(mutex_);
+    events_[next_] = Event {
+        name, detail,
+        chrono::duration_cast<chrono::microseconds>(started - epoch_).count(),
+        chrono::duration_cast<chrono::microseconds>(finished - started).count(),
+        thread
+    };
+    if (++next_ == events_.size()) {
+        next_ = 0;
+        wrapped_ = true;
+    }
+    dirty_ = true;
+}
+
+void Tracer::write(ostream &out) {
+    lock_guard<mutex> lock(mutex_);
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    // Oldest first: once wrapped, the oldest span is the one we overwrite
+    // next
+    size_t count = wrapped_ ? events_.size() : next_;
+    size_t first = wrapped_ ? next_ : 0;
+    int pid = getpid();
+    for (size_t i = 0; i < count; ++i) {
+        const Event &event = events_[(first + i) % events_.size()];
+        out << (i ? ",\n" : "\n") << "{\"name\":";
+        write_string(out, event.name);
+        out << ",\"cat\":\"ddg\",\"ph\":\"X\",\"ts\":" << event.start
+            << ",\"dur\":" << event.duration << ",\"pid\":" << pid
+            << ",\"tid\":" << event.thread;
+        if (event.detail) {
+            out << ",\"args\":{\"detail\":";
+            write_string(out, event.detail);
+            out << "}";
+        }
+        out << "}";
+    }
+    out << "\n]}\n";
+}
+
+bool Tracer::flush() {
+    if (!enabled()) {
+        return false;
+    }
+
+    string path;
+    {
+        lock_guard<mutex> lock(mutex_);
+        if (!dirty_) {
+            return true;
+        }
+        dirty_ = false;
+        path = path_;
+    }
+
+    // Readers see either the old or the new trace
+    string tmp = path + ".tmp";
+    bool written;
+    {
+        ofstream out(tmp, ios::trunc);
+        write(out);
+        written = bool(out.flush());
+    }
+    if (written && rename(tmp.c_str(), path.c_str()) == 0) {
+        return true;
+    }
+
+    // Try again next time
+    lock_guard<mutex> lock(mutex_);
+    dirty_ = true;
+    return false;
+}
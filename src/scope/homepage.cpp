@@ -0,0 +1,75 @@
+#include <scope/homepage.h>
+
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+using namespace api;
+using namespace scope;
+
+Homepage::Homepage(Config::Ptr config, HttpPool::Ptr pool,
+                   CircuitBreaker::Ptr breaker) :
+    config_(config), pool_(pool), breaker_(breaker), stopped_(false) {
+}
+
+Homepage::~Homepage() {
+    stop();
+}
+
+void Homepage::start() {
+    worker_ = thread(&Homepage::refresh, this);
+}
+
+void Homepage::stop() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        stopped_ = true;
+        if (client_) {
+            client_->cancel();
+        }
+    }
+    wake_.notify_all();
+
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+Homepage::Snapshot Homepage::snapshot() {
+    lock_guard<mutex> lock(mutex_);
+    return snapshot_;
+}
+
+void Homepage::refresh() {
+    unique_lock<mutex> lock(mutex_);
+
+    while (!stopped_) {
+        auto client = make_shared<Client>(config_, pool_, breaker_);
+        client_ = client;
+        lock.unlock();
+
+        Snapshot homepage;
+        try {
+            homepage = make_shared<const Client::HomePage>(
+                    client->homepageResults("com.ubuntu.ddg"));
+        } catch (exception &e) {
+            cerr << "Homepage refresh failed: " << e.what() << endl;
+        }
+
+        lock.lock();
+        client_.reset();
+
+        // Keep serving the old data if the refresh didn't get anything,
+        // and try again sooner
+        bool failed = !homepage || homepage->isEmpty();
+        if (!snapshot_ || (!failed && !client->cancelled())) {
+            snapshot_ = homepage ? homepage : make_shared<const Client::HomePage>();
+        }
+
+        wake_.wait_for(lock,
+                failed ? config_->homepage_retry : config_->homepage_refresh,
+                [this]() {
+                    return stopped_;
+                });
+    }
+}
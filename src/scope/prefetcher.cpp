@@ -0,0 +1,180 @@
+#include <api/metrics.h>
+
+#include <scope/prefetcher.h>
+
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+using namespace api;
+using namespace scope;
+
+Prefetcher::Prefetcher(Config::Ptr config, SingleFlight::Ptr flights,
+                       Scheduler::Ptr scheduler, ResultCache::Ptr cache,
+                       DiskCache::Ptr disk_cache) :
+    config_(config), flights_(flights), scheduler_(scheduler), cache_(cache),
+    disk_cache_(disk_cache), stopped_(false) {
+}
+
+Prefetcher::~Prefetcher() {
+    stop();
+}
+
+void Prefetcher::start() {
+    self_ = shared_from_this();
+    for (unsigned int i = 0; i < config_->prefetch_concurrency; ++i) {
+        workers_.emplace_back(&Prefetcher::work, this);
+    }
+}
+
+void Prefetcher::stop() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        stopped_ = true;
+        queue_.clear();
+        for (const auto &running : running_) {
+            running.first->cancel();
+        }
+        running_.clear();
+    }
+    wake_.notify_all();
+
+    for (auto &worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+void Prefetcher::queue(const vector<string> &queries) {
+    {
+        lock_guard<mutex> lock(mutex_);
+        if (stopped_) {
+            return;
+        }
+        for (const auto &query : queries) {
+            // Queued and cached under the key the searches use
+            string key = SingleFlight::normalize(query);
+            if (key.empty() || cache_->get(key) ||
+                    find(queue_.begin(), queue_.end(), key) != queue_.end()) {
+                continue;
+            }
+            // The latest search tells best what comes next
+            if (queue_.size() >= config_->prefetch_queue) {
+                queue_.pop_front();
+            }
+            queue_.push_back(key);
+        }
+    }
+    wake_.notify_all();
+}
+
+void Prefetcher::yield(const string &query) {
+    string key = SingleFlight::normalize(query);
+
+    lock_guard<mutex> lock(mutex_);
+    for (auto it = running_.begin(); it != running_.end();) {
+        // The search is waiting for these results too
+        if (it->second == key) {
+            ++it;
+            continue;
+        }
+        // Each prefetch is aborted once, the worker will find it cancelled
+        it->first->cancel();
+        it = running_.erase(it);
+        ++Metrics::instance().prefetch_aborts;
+    }
+}
+
+bool Prefetcher::idle() {
+    return stopped_ || scheduler_->active() == 0;
+}
+
+void Prefetcher::work() {
+    unique_lock<mutex> lock(mutex_);
+
+    while (true) {
+        wake_.wait(lock, [this]() {
+            return stopped_ || !queue_.empty();
+        });
+        if (stopped_) {
+            return;
+        }
+
+        // Searches go first, look again in a while
+        if (!wake_.wait_for(lock, config_->prefetch_idle, [this]() {
+                    return idle();
+                })) {
+            continue;
+        }
+        if (stopped_ || queue_.empty()) {
+            continue;
+        }
+
+        string query = queue_.front();
+        queue_.pop_front();
+        if (cache_->get(query)) {
+            continue;
+        }
+
+        // Results of a previous run of the scope only need loading, and the
+        // disk is read without keeping searches waiting in #yield
+        if (disk_cache_) {
+            lock.unlock();
+            ResultCache::Entry results = disk_cache_->get(query);
+            if (results) {
+                cache_->put(query, results);
+            }
+            lock.lock();
+
+            if (results || stopped_) {
+                continue;
+            }
+            if (!idle()) {
+                queue_.push_front(query);
+                continue;
+            }
+        }
+
+        // Joining the flights, a search for the same query waits for our
+        // fetch instead of sending its own requests
+        ResultCache::Ptr cache = cache_;
+        DiskCache::Ptr disk_cache = disk_cache_;
+        weak_ptr<Prefetcher> self = self_;
+        auto waiter = flights_->join(query,
+                [self, cache, disk_cache, query](Client &client,
+                                                 const Client::Partial &) {
+            auto prefetcher = self.lock();
+            if (!prefetcher) {
+                return make_shared<const Client::QueryResults>();
+            }
+            auto results = make_shared<const Client::QueryResults>(
+                    prefetcher->fetch(client, query));
+
+            if (!client.cancelled() && !results->degraded &&
+                    !results->isEmpty()) {
+                cache->put(query, results);
+                if (disk_cache) {
+                    disk_cache->put(query, *results);
+                }
+            }
+            return results;
+        });
+        running_[waiter] = query;
+        ++Metrics::instance().prefetches;
+        lock.unlock();
+
+        try {
+            waiter->wait();
+        } catch (exception &e) {
+            cerr << "Prefetch of " << query << " failed: " << e.what() << endl;
+        }
+
+        lock.lock();
+        running_.erase(waiter);
+    }
+}
+
+Client::QueryResults Prefetcher::fetch(Client &client, const string &query) {
+    return client.queryResults(query);
+}
@@ -1,7 +1,13 @@
 #include <boost/algorithm/string/trim.hpp>
 
+#include <api/ingest.h>
+#include <api/markup.h>
+#include <api/metrics.h>
+#include <api/tracer.h>
+
 #include <scope/localization.h>
 #include <scope/query.h>
+#include <scope/topic.h>
 
 #include <unity/scopes/Annotation.h>
 #include <unity/scopes/CategorisedResult.h>
@@ -9,8 +15,12 @@
 #include <unity/scopes/QueryBase.h>
 #include <unity/scopes/SearchReply.h>
 
+#include <algorithm>
+#include <chrono>
 #include <iomanip>
+#include <limits>
 #include <sstream>
+#include <vector>
 #include <QDebug>
 
 namespace sc = unity::scopes;
@@ -20,152 +30,398 @@ using namespace std;
 using namespace api;
 using namespace scope;
 
+namespace {
 
 /**
- * Define the layout for the abstract responses
- *
- * The card is large, with a little photo, to have the maximum number of
- * information available
+ * Text taken out of the HTML of a topic, as it's shown
  */
-const static string ABSTRACT_TEMPLATE =
-    R"(
-        {
-            "schema-version": 1,
-            "template": {
-                "category-layout": "grid",
-                "card-layout": "horizontal",
-                "card-size": "large"
-            },
-            "components": {
-                "title": "title",
-                "subtitle": "subtitle",
-                "art" : {
-                    "field": "art"
-                },
-                "summary": "summary",
-                "type": "type"
-            }
+string display(boost::string_ref text) {
+    Arena arena;
+    return Ingest::clean(text, arena).to_string();
+}
+
+}
+
+const string Query::FULL = "full";
+
+Query::Query(const sc::CannedQuery &query, const sc::SearchMetadata &metadata,
+             Context::Ptr context) :
+    sc::SearchQueryBase(query, metadata), context_(context),
+    cancelled_(false), first_card_(false),
+    cap_(numeric_limits<size_t>::max()) {
+    fill(begin(pushed_), end(pushed_), false);
+
+    // Every push is a message to the shell: a phone shows a few cards of a
+    // list, and the others are asked for
+    if (query.department_id() != FULL) {
+        cap_ = metadata.form_factor() == "phone" ?
+                    context_->config->phone_cards :
+                    context_->config->desktop_cards;
+        if (metadata.cardinality() > 0) {
+            cap_ = min(cap_, static_cast<size_t>(metadata.cardinality()));
         }
-    )";
+    }
+}
 
-/**
- * Infobox template, for a lot of informations :-)
- *
- * Cards are little, with only essential informations: the name of the data,
- * and the data itself
- */
-const static string INFOBOX_TEMPLATE =
-    R"(
-        {
-            "schema-version": 1,
-            "template": {
-                "category-layout": "vertical-journal",
-                "card-layout": "horizontal",
-                "card-size": "small"
-            },
-            "components": {
-                "title": "title",
-                "summary": "summary",
-                "type": "type"
-            }
+void Query::cancelled() {
+    lock_guard<mutex> lock(mutex_);
+    if (!cancelled_) {
+        ++Metrics::instance().cancellations;
+    }
+    cancelled_ = true;
+
+    // The requests are aborted only if no other query waits for them
+    if (waiter_) {
+        waiter_->cancel();
+    }
+}
+
+string Query::session() const {
+    const sc::SearchMetadata &metadata = search_metadata();
+    if (metadata.contains_hint("session-id")) {
+        return metadata["session-id"].get_string();
+    }
+
+    // Without a session we can't tell which searches supersede each other,
+    // and searches of different users must not abort each other
+    return string();
+}
+
+ResultCache::Entry Query::fetch(sc::SearchReplyProxy const& reply,
+                                const string &query_string) {
+    SingleFlight::Waiter::Ptr waiter;
+    {
+        lock_guard<mutex> lock(mutex_);
+        if (cancelled_) {
+            return ResultCache::Entry();
         }
-    )";
 
-/**
- * Answer template, for simple questions with a simple answer
- */
-const static string ANSWER_TEMPLATE =
-    R"(
-        {
-            "schema-version": 1,
-            "template": {
-                "category-layout": "vertical-journal",
-                "card-layout": "horizontal",
-                "card-size": "large"
-            },
-            "components": {
-                "title": "title",
-                "summary": "summary",
-                "type": "type"
+        // Identical searches running at the same time share the requests,
+        // and their results are cached under the key of the flight
+        Context::Ptr context = context_;
+        string key = SingleFlight::normalize(query_string);
+        waiter_ = context_->flights->join(query_string,
+                [context, query_string, key](Client &client,
+                                        const Client::Partial &partial) {
+            auto results = make_shared<const Client::QueryResults>(
+                    client.queryResults(query_string, partial));
+
+            // Partial results of a cancelled or late query are not worth
+            // keeping
+            if (!client.cancelled() && !results->degraded &&
+                    !results->isEmpty()) {
+                context->cache->put(key, results);
+                if (context->disk_cache) {
+                    context->disk_cache->put(key, *results);
+                }
             }
+            return results;
+        });
+        waiter = waiter_;
+    }
+
+    // Background prefetches give way to our requests. Once we joined the
+    // flights, the prefetch of this same query goes on for us.
+    if (context_->prefetcher) {
+        context_->prefetcher->yield(query_string);
+    }
+
+    // Show what the ?q= response brings while we wait for the others. Once
+    // the shell doesn't take our cards anymore, we stop waiting: the requests
+    // are aborted unless another query waits for them.
+    Tracer::Span span("wait");
+    return waiter->wait([this, &reply, &waiter](const Client::QueryResults &results) {
+        if (!render(reply, results, false)) {
+            waiter->cancel();
         }
-    )";
+    });
+}
 
-/**
- * This template is for list of things related to a topic
- * The response type has to be C
- */
-const static string CATEGORIES_TEMPLATE =
-    R"(
-        {
-            "schema-version": 1,
-            "template": {
-                "category-layout": "grid",
-                "overlay": true,
-                "card-size": "medium"
-            },
-            "components": {
-                "title": "title",
-                "summary": "summary",
-                "art": {
-                    "field": "art"
-                },
-                "type": "type"
-            }
+ResultCache::Entry Query::stale(const string &key) {
+    ResultCache::Entry results = context_->cache->get(key, true);
+    if (!results && context_->disk_cache) {
+        results = context_->disk_cache->get(key, true);
+    }
+    if (results) {
+        ++Metrics::instance().stale_cache_hits;
+    }
+    return results;
+}
+
+bool Query::push(sc::SearchReplyProxy const& reply,
+                 const sc::CategorisedResult &res) {
+    // A superseded search stops pushing, as if the shell cancelled it
+    {
+        lock_guard<mutex> lock(mutex_);
+        if (cancelled_) {
+            return false;
         }
-    )";
+    }
 
-/**
- * This template is for disambiguation, it's similar to type C but it's D
- */
-const static string DISAMBIGUATION_TEMPLATE =
-    R"(
-        {
-            "schema-version": 1,
-            "template": {
-                "category-layout": "carousel",
-                "overlay": true
-            },
-            "components": {
-                "title": "title",
-                "summary": "summary",
-                "art": {
-                    "field": "art"
-                },
-                "type": "type"
-            }
+    Metrics &metrics = Metrics::instance();
+    if (!first_card_) {
+        first_card_ = true;
+        metrics.first_card.record(
+                chrono::duration_cast<chrono::microseconds>(
+                    chrono::steady_clock::now() - started_));
+    }
+
+    Metrics::Timer timer(metrics.push);
+    return reply->push(res);
+}
+
+bool Query::more(sc::SearchReplyProxy const& reply,
+                 const sc::Category::SCPtr &category, size_t total) {
+    // The same search, in the department where nothing is left out
+    sc::CannedQuery full(query());
+    full.set_department_id(FULL);
+
+    sc::CategorisedResult res(category);
+    res.set_uri(full.to_uri());
+    res.set_title("Show all " + to_string(total));
+    res["summary"] = to_string(total - cap_) + " more";
+
+    return push(reply, res);
+}
+
+bool Query::render(sc::SearchReplyProxy const& reply,
+                   const Client::QueryResults &queryResults, bool final) {
+    Metrics::Timer timer(Metrics::instance().render);
+
+    // A pushed card can't be updated, and the merge only fills the fields
+    // the ?q= response misses: until the final results, a card waits for
+    // all the fields of the abstract it shows
+    const Client::Abstract &about = queryResults.abstract;
+    bool sourced = final || !about.source.empty();
+    bool complete = sourced && (final || (!about.url.empty() &&
+            !about.imageUrl.empty() && !about.heading.empty()));
+
+    if (!pushed_[ABSTRACT] && complete &&
+            !queryResults.abstract.textSummary.empty()) {
+        pushed_[ABSTRACT] = true;
+        if (!abstract(reply, queryResults)) {
+            return false;
+        }
+    }
+
+    if (!pushed_[INFOBOX] && complete && !queryResults.infobox.empty()) {
+        pushed_[INFOBOX] = true;
+        if (!infobox(reply, queryResults)) {
+            return false;
         }
-    )";
+    }
 
-/*
- * 404 page - Nothing return from the query
- */
-const static string EMPTY_TEMPLATE =
-    R"(
-        {
-            "schema-version": 1,
-            "template": {
-                "category-layout": "grid",
-                "card-size": "large"
-            },
-            "components": {
-                "title": "title",
-                "summary": "summary",
-                "type": "type"
-            }
+    if (!pushed_[ANSWER] && sourced && !queryResults.answer.type.empty()) {
+        pushed_[ANSWER] = true;
+        if (!answer(reply, queryResults)) {
+            return false;
         }
-    )";
+    }
 
-Query::Query(const sc::CannedQuery &query, const sc::SearchMetadata &metadata,
-             Config::Ptr config) :
-    sc::SearchQueryBase(query, metadata), client_(config) {
+    // We don't want categories and disambiguations if we have an infobox:
+    // only the complete results can tell that there isn't one
+    if (!final || pushed_[INFOBOX]) {
+        return true;
+    }
+
+    if (!pushed_[CATEGORY] && queryResults.type == "C") {
+        pushed_[CATEGORY] = true;
+        if (!category(reply, queryResults)) {
+            return false;
+        }
+    }
+
+    if (!pushed_[DISAMBIGUATION] && queryResults.type == "D") {
+        pushed_[DISAMBIGUATION] = true;
+        if (!disambiguation(reply, queryResults)) {
+            return false;
+        }
+    }
+
+    return true;
 }
 
-void Query::cancelled() {
-    client_.cancel();
+bool Query::abstract(sc::SearchReplyProxy const& reply,
+                     const Client::QueryResults &queryResults) {
+    Tracer::Span span("push", "abstract");
+
+    // Register a category for the abstract
+    auto abstract_cat = reply->register_category("abstract",
+            queryResults.abstract.heading.to_string(), "",
+            context_->renderers->abstract);
+
+    // Create a single result for the current abstract
+    sc::CategorisedResult res(abstract_cat);
+
+    // Set results
+    res.set_uri(queryResults.abstract.url.to_string());
+    res.set_title(queryResults.abstract.heading.to_string());
+    res.set_art(queryResults.abstract.imageUrl.to_string());
+    res["summary"] = queryResults.abstract.textSummary.to_string();
+    if (queryResults.abstract.source != "") {
+        res["subtitle"] = "Source: " + queryResults.abstract.source.to_string();
+    }
+
+    // Push the result
+    return push(reply, res);
+}
+
+bool Query::infobox(sc::SearchReplyProxy const& reply,
+                    const Client::QueryResults &queryResults) {
+    Tracer::Span span("push", "infobox");
+
+    // Register a category for the infobox
+    auto infobox_cat = reply->register_category("infobox",
+            "", "", context_->renderers->infobox);
+
+    // For each of the informations in the infobox, create a card
+    size_t cards = 0;
+    for (const auto &content : queryResults.infobox) {
+        if (cards++ == cap_) {
+            return more(reply, infobox_cat, queryResults.infobox.size());
+        }
+
+        // Create a result
+        sc::CategorisedResult res(infobox_cat);
+
+        // Set informations
+        res.set_uri(queryResults.abstract.url.to_string());
+        res.set_title(content.label.to_string());
+        res["summary"] = content.value.to_string();
+
+        // These are only for the preview
+        res.set_art(queryResults.abstract.imageUrl.to_string());
+        res["subtitle"] = "Source: " + queryResults.abstract.source.to_string();
+
+        // Push the result
+        if (!push(reply, res)) {
+            // If we fail to push, it means the query has been cancelled.
+            // So don't continue;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Query::answer(sc::SearchReplyProxy const& reply,
+                   const Client::QueryResults &queryResults) {
+    Tracer::Span span("push", "answer");
+
+    // Register a category for answer
+    auto answer_cat = reply->register_category("answer", "", "",
+            context_->renderers->answer);
+
+    // Create a single result for the answer
+    sc::CategorisedResult res(answer_cat);
+
+    // We must have a URI, anyway we will not use it
+    res.set_uri(queryResults.answer.type.to_string());
+    res.set_title(queryResults.answer.type.to_string());
+    res["summary"] = queryResults.answer.instantAnswer.to_string();
+    if (queryResults.abstract.source != "") {
+        res["subtitle"] = "Source: " + queryResults.abstract.source.to_string();
+    }
+
+    res["type"] = queryResults.type.to_string();
+
+    // Push the result
+    return push(reply, res);
+}
+
+bool Query::category(sc::SearchReplyProxy const& reply,
+                     const Client::QueryResults &queryResults) {
+    Tracer::Span span("push", "category");
+
+    // Register a category for the category
+    auto category_cat = reply->register_category("category",
+            queryResults.abstract.heading.to_string(), "",
+            context_->renderers->categories);
+
+    // For each element of the category
+    size_t cards = 0;
+    for (const auto &content : queryResults.relatedTopics) {
+        if (cards++ == cap_) {
+            return more(reply, category_cat, queryResults.relatedTopics.size());
+        }
+
+        // Create a result
+        sc::CategorisedResult res(category_cat);
+
+        // Take the title of the result, the description follows a dash
+        Topic topic = Topic::parse(content.result, " - ");
+        res.set_title(display(topic.title));
+        res["summary"] = display(topic.summary);
+
+        // Disabled due bug
+        // https://bugs.launchpad.net/ubuntu/+source/unity-scopes-shell/+bug/1335761
+        // Remove https://www.duckduckgo.com/
+        // res.set_uri(content.url.substr(23));
+        res.set_uri(content.url.to_string());
+        res.set_art(content.icon.url.to_string());
+
+        // Only for the preview
+        res["subtitle"] = "Source: " + queryResults.abstract.source.to_string();
+        res["type"] = queryResults.type.to_string();
+
+        // Push the result
+        if (!push(reply, res)) {
+            // If we fail to push, it means the query has been cancelled.
+            // So don't continue;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Query::disambiguation(sc::SearchReplyProxy const& reply,
+                           const Client::QueryResults &queryResults) {
+    Tracer::Span span("push", "disambiguation");
+
+    // Register a category for the category
+    auto disambiguation_cat = reply->register_category("disambiguation",
+            "Meanings", "",
+            context_->renderers->disambiguation);
+
+    // For each element of the category
+    size_t cards = 0;
+    for (const auto &content : queryResults.relatedTopics) {
+        if (cards++ == cap_) {
+            return more(reply, disambiguation_cat, queryResults.relatedTopics.size());
+        }
+
+        // Create a result
+        sc::CategorisedResult res(disambiguation_cat);
+
+        // Take the title of the result, the description follows right away
+        Topic topic = Topic::parse(content.result, "");
+        res.set_title(display(topic.title));
+        res["summary"] = display(topic.summary);
+
+        // Remove https://www.duckduckgo.com/
+        // Disabled due bug
+        // https://bugs.launchpad.net/ubuntu/+source/unity-scopes-shell/+bug/1335761
+        //res.set_uri(content.url.substr(23));
+        res.set_uri(content.url.to_string());
+        res.set_art(content.icon.url.to_string());
+
+        // Only for the preview
+        res["subtitle"] = "Source: " + queryResults.abstract.source.to_string();
+        res["type"] = queryResults.type.to_string();
+
+        // Push the result
+        if (!push(reply, res)) {
+            // If we fail to push, it means the query has been cancelled.
+            // So don't continue;
+            return false;
+        }
+    }
+    return true;
 }
 
 void Query::run(sc::SearchReplyProxy const& reply) {
+    started_ = chrono::steady_clock::now();
+    Tracer::Span span("Query::run");
+
     try {
         // Start by getting information about the query
         const sc::CannedQuery &query(sc::SearchQueryBase::query());
@@ -175,31 +431,34 @@ void Query::run(sc::SearchReplyProxy const& reply) {
 
         if (query_string.empty()) {
             // Default page is managed by this special query
-            Client::HomePage homepage;
-            homepage = client_.homepageResults("com.ubuntu.ddg");
+            // Its data is kept up to date in background, we never wait for
+            // the network here
+            static const Client::HomePage NOT_LOADED;
+            Homepage::Snapshot snapshot = context_->homepage->snapshot();
+            const Client::HomePage &homepage = snapshot ? *snapshot : NOT_LOADED;
 
             // Sunrise and sunset, we need to take only data we need and put
             // in right infobox
-            auto sunrise_cat = reply->register_category("sunrise",
-                "", "", sc::CategoryRenderer(INFOBOX_TEMPLATE));
-            {
+            if (!homepage.sunrise.instantAnswer.empty()) {
+                auto sunrise_cat = reply->register_category("sunrise",
+                    "", "", context_->renderers->infobox);
+
                 sc::CategorisedResult res(sunrise_cat);
 
-                std::string sunrise = homepage.sunrise.instantAnswer;
+                Markup::Sunrise sunrise =
+                        Markup::sunrise(homepage.sunrise.instantAnswer);
 
                 // We set the uri to don't have any action in the previw
                 res.set_uri("fortune.ddg.home");
 
-                // Remove @</span> from the title
-                std::size_t startPos = sunrise.find("@") + 8;
-                std::size_t endPos = sunrise.find("</div>");
                 std::string title =  "Sunrise and sunset at ";
-                title += sunrise.substr(startPos, endPos - startPos);
+                title.append(sunrise.location.data(), sunrise.location.size());
                 res.set_title(title);
 
                 // Take the sunrise and the sunset
-                startPos = sunrise.find("<span class='suninfo--risebox'>");
-                res["summary"] = sunrise.substr(startPos);
+                if (!sunrise.times.empty()) {
+                    res["summary"] = sunrise.times.to_string();
+                }
 
                 // Push the result
                 if (!reply->push(res)) {
@@ -210,16 +469,16 @@ void Query::run(sc::SearchReplyProxy const& reply) {
             }
 
             // Fortune cookie, we use the same template we use for infobox
-            auto fortune_cat = reply->register_category("fortune",
-                "", "", sc::CategoryRenderer(INFOBOX_TEMPLATE));
+            if (!homepage.fortune.instantAnswer.empty()) {
+                auto fortune_cat = reply->register_category("fortune",
+                    "", "", context_->renderers->infobox);
 
-            {
                 sc::CategorisedResult res(fortune_cat);
 
                 // We set the uri to don't have any action in the preview
                 res.set_uri("fortune.ddg.home");
                 res.set_title("Fortune cookie");
-                res["summary"] = homepage.fortune.instantAnswer;
+                res["summary"] = homepage.fortune.instantAnswer.to_string();
 
                 // Push the result
                 if (!reply->push(res)) {
@@ -235,7 +494,7 @@ void Query::run(sc::SearchReplyProxy const& reply) {
              */
             // Register a category for the footer
              auto footer_cat = reply->register_category("footer",
-                _(""), "", sc::CategoryRenderer(INFOBOX_TEMPLATE));
+                _(""), "", context_->renderers->infobox);
 
              {
                 // Create a result
@@ -257,10 +516,11 @@ void Query::run(sc::SearchReplyProxy const& reply) {
 
             /**
              * 404: nothing found!
+             * Until the first refresh is done we can't tell
              */
-            if (homepage.isEmpty()) {
+            if (snapshot && homepage.isEmpty()) {
                 auto empty_cat = reply->register_category("empty",
-                        _("Nothing found"), "", sc::CategoryRenderer(EMPTY_TEMPLATE));
+                        _("Nothing found"), "", context_->renderers->empty);
 
                 {
                     // Create a result
@@ -281,199 +541,88 @@ void Query::run(sc::SearchReplyProxy const& reply) {
             }
         } else {
             // otherwise, process the query
-            Client::QueryResults queryResults;
-            queryResults = client_.queryResults(query_string);
-
-            /**
-             *  Abstract
-             */
-            if (!queryResults.abstract.textSummary.empty()) {
-                // Register a category for the abstract
-                auto abstract_cat = reply->register_category("abstract",
-                        queryResults.abstract.heading, "", sc::CategoryRenderer(ABSTRACT_TEMPLATE));
-
-                {
-                    // Create a single result for the current abstract
-                    sc::CategorisedResult res(abstract_cat);
-
-                    // Set results
-                    res.set_uri(queryResults.abstract.url);
-                    res.set_title(queryResults.abstract.heading);
-                    res.set_art(queryResults.abstract.imageUrl);
-                    res["summary"] = queryResults.abstract.textSummary;
-                    if (queryResults.abstract.source != "") {
-                        res["subtitle"] = "Source: " + queryResults.abstract.source;
-                    }
-
-                    // Push the result
-                    if (!reply->push(res)) {
-                        // If we fail to push, it means the query has been cancelled.
-                        // So don't continue;
-                        return;
-                    }
+            // This search supersedes the older ones of the same session
+            string session = this->session();
+            uint64_t id = context_->scheduler->admit(session, [this]() {
+                cancelled();
+            });
+
+            // Forget about this search however we leave
+            struct Finish {
+                Scheduler &scheduler;
+                const string &session;
+                uint64_t id;
+                ~Finish() {
+                    scheduler.finish(session, id);
                 }
+            } finish { *context_->scheduler, session, id };
+
+            Metrics &metrics = Metrics::instance();
+            ++metrics.searches;
+
+            // Results searched a few seconds ago are still in the cache, and
+            // don't need to go to the network again. Queries differing by case
+            // or spacing share them.
+            string key = SingleFlight::normalize(query_string);
+            ResultCache::Entry results = context_->cache->get(key);
+            if (results) {
+                ++metrics.memory_cache_hits;
             }
 
-            /**
-             * Infobox
-             */
-            if (!queryResults.infobox.empty()) {
-                // Register a category for the infobox
-                auto infobox_cat = reply->register_category("infobox",
-                        "", "", sc::CategoryRenderer(INFOBOX_TEMPLATE));
-
-                {
-                    // For each of the informations in the infobox, create a card
-                    for (const auto &content : queryResults.infobox) {
-                        // Create a result
-                        sc::CategorisedResult res(infobox_cat);
-
-                        // Set informations
-                        res.set_uri(queryResults.abstract.url);
-                        res.set_title(content.label);
-                        res["summary"] = content.value;
-
-                        // These are only for the preview
-                        res.set_art(queryResults.abstract.imageUrl);
-                        res["subtitle"] = "Source: " + queryResults.abstract.source;
-
-                        // Push the result
-                        if (!reply->push(res)) {
-                            // If we fail to push, it means the query has been cancelled.
-                            // So don't continue;
-                            return;
-                        }
-                    }
+            // Then try with the results stored by a previous run of the scope
+            if (!results && context_->disk_cache) {
+                results = context_->disk_cache->get(key);
+                if (results) {
+                    ++metrics.disk_cache_hits;
+                    context_->cache->put(key, results);
                 }
             }
 
-            /**
-             * Answer
-             */
-            if (!queryResults.answer.type.empty()) {
-                // Register a category for answer
-                auto answer_cat = reply->register_category("answer", "", "",
-                        sc::CategoryRenderer(ANSWER_TEMPLATE));
-
-                {
-                    // Create a single result for the answer
-                    sc::CategorisedResult res(answer_cat);
-
-                    // We must have a URI, anyway we will not use it
-                    res.set_uri(queryResults.answer.type);
-                    res.set_title(queryResults.answer.type);
-                    res["summary"] = queryResults.answer.instantAnswer;
-                    if (queryResults.abstract.source != "") {
-                        res["subtitle"] = "Source: " + queryResults.abstract.source;
-                    }
+            // While the API is down, old results are better than none
+            if (!results && context_->breaker->tripped()) {
+                results = stale(key);
+            }
 
-                    res["type"] = queryResults.type;
+            if (!results) {
+                ++metrics.cache_misses;
 
-                    // Push the result
-                    if (!reply->push(res)) {
-                        // If we fail to push, it means the query has been cancelled.
-                        // So don't continue;
-                        return;
-                    }
+                // Give the user the time to type a short query in full
+                if (!context_->scheduler->debounce(session, id, query_string)) {
+                    return;
                 }
-            }
 
-            /**
-             * Category
-             * We don't want this if we already have an infobox
-             */
-            if (queryResults.infobox.empty() && queryResults.type == "C") {
-                // Register a category for the category
-                auto category_cat = reply->register_category("category",
-                        queryResults.abstract.heading, "",
-                        sc::CategoryRenderer(CATEGORIES_TEMPLATE));
+                results = fetch(reply, query_string);
 
-                {
-                    // For each element of the category
-                    for (const auto &content : queryResults.relatedTopics) {
-                        // Create a result
-                        sc::CategorisedResult res(category_cat);
-
-                        // Take the title of the result
-                        std::size_t startPos = content.result.find("\">") + 2;
-                        std::size_t endPos = content.result.find("</a>");
-                        res.set_title(content.result.substr(startPos, endPos - startPos));
-                        // 7 chars: "</a> - "
-                        res["summary"] = content.result.substr(endPos+7);
-
-                        // Disabled due bug
-                        // https://bugs.launchpad.net/ubuntu/+source/unity-scopes-shell/+bug/1335761
-                        // Remove https://www.duckduckgo.com/
-                        // res.set_uri(content.url.substr(23));
-                        res.set_uri(content.url);
-                        res.set_art(content.icon.url);
-
-                        // Only for the preview
-                        res["subtitle"] = "Source: " + queryResults.abstract.source;
-                        res["type"] = queryResults.type;
-
-                        // Push the result
-                        if (!reply->push(res)) {
-                            // If we fail to push, it means the query has been cancelled.
-                            // So don't continue;
-                            return;
-                        }
-                    }
+                // We have been cancelled while waiting
+                if (!results) {
+                    return;
                 }
-            }
 
-            /**
-             * Disambiguation
-             * We don't want this if we already have an infobox
-             */
-            if (queryResults.infobox.empty() && queryResults.type == "D") {
-                // Register a category for the category
-                auto disambiguation_cat = reply->register_category("disambiguation",
-                        "Meanings", "",
-                        sc::CategoryRenderer(DISAMBIGUATION_TEMPLATE));
-
-                {
-                    // For each element of the category
-                    for (const auto &content : queryResults.relatedTopics) {
-                        // Create a result
-                        sc::CategorisedResult res(disambiguation_cat);
-
-                        // Take the title of the result
-                        std::size_t startPos = content.result.find("\">") + 2;
-                        std::size_t endPos = content.result.find("</a>");
-                        res.set_title(content.result.substr(startPos, endPos - startPos));
-                        // 4 chars: "</a>"
-                        res["summary"] = content.result.substr(endPos+4);
-
-                        // Remove https://www.duckduckgo.com/
-                        // Disabled due bug
-                        // https://bugs.launchpad.net/ubuntu/+source/unity-scopes-shell/+bug/1335761
-                        //res.set_uri(content.url.substr(23));
-                        res.set_uri(content.url);
-                        res.set_art(content.icon.url);
-
-                        // Only for the preview
-                        res["subtitle"] = "Source: " + queryResults.abstract.source;
-                        res["type"] = queryResults.type;
-
-                        // Push the result
-                        if (!reply->push(res)) {
-                            // If we fail to push, it means the query has been cancelled.
-                            // So don't continue;
-                            return;
-                        }
+                // The requests failed: old results are better than none
+                if (results->degraded && results->isEmpty()) {
+                    ResultCache::Entry old = stale(key);
+                    if (old) {
+                        results = old;
                     }
                 }
             }
+            const Client::QueryResults &queryResults = *results;
+
+            // The sections the first response could fill are already there
+            if (!render(reply, queryResults, true)) {
+                return;
+            }
 
             /**
              * 404: nothing found!
              */
             if (queryResults.isEmpty()) {
                 auto empty_cat = reply->register_category("empty",
-                        _("Nothing found"), "", sc::CategoryRenderer(EMPTY_TEMPLATE));
+                        _("Nothing found"), "", context_->renderers->empty);
 
                 {
+                    Tracer::Span span("push", "empty");
+
                     // Create a result
                     sc::CategorisedResult res(empty_cat);
 
@@ -485,7 +634,7 @@ void Query::run(sc::SearchReplyProxy const& reply) {
                     res["labelText"] = "Results on DDG";
 
                     // Push the result
-                    if (!reply->push(res)) {
+                    if (!push(reply, res)) {
                         // If we fail to push, it means the query has been cancelled.
                         // So don't continue;
                         return;
@@ -498,9 +647,11 @@ void Query::run(sc::SearchReplyProxy const& reply) {
              */
             // Register a category for the footer
             auto footer_cat = reply->register_category("footer",
-                    _(""), "", sc::CategoryRenderer(INFOBOX_TEMPLATE));
+                    _(""), "", context_->renderers->infobox);
 
             {
+                Tracer::Span span("push", "footer");
+
                 // Create a result
                 sc::CategorisedResult res(footer_cat);
 
@@ -511,15 +662,36 @@ void Query::run(sc::SearchReplyProxy const& reply) {
                 res["summary"] = "Results from DuckDuckGo";
 
                 // Push the result
-                if (!reply->push(res)) {
+                if (!push(reply, res)) {
                     // If we fail to push, it means the query has been cancelled.
                     // So don't continue;
                     return;
                 }
             }
+
+            Metrics::instance().last_card.record(
+                    chrono::duration_cast<chrono::microseconds>(
+                        chrono::steady_clock::now() - started_));
+
+            // The user is likely to search one of the first topics next
+            bool topics = queryResults.type == "C" || queryResults.type == "D";
+            if (topics && context_->prefetcher) {
+                vector<string> queries;
+                for (const auto &content : queryResults.relatedTopics) {
+                    if (queries.size() == context_->config->prefetch_topics) {
+                        break;
+                    }
+                    Topic topic = Topic::parse(content.result,
+                            queryResults.type == "C" ? " - " : "");
+                    queries.emplace_back(
+                            alg::trim_copy(display(topic.title)));
+                }
+                context_->prefetcher->queue(queries);
+            }
         }
     } catch (domain_error &e) {
         // Handle exceptions being thrown by the client API
+        ++Metrics::instance().errors;
         cerr << e.what() << endl;
         reply->error(current_exception());
     }
@@ -0,0 +1,13 @@
+#include <scope/renderers.h>
+#include <scope/templates.h>
+
+using namespace scope;
+
+Renderers::Renderers() :
+    abstract(templates::ABSTRACT),
+    infobox(templates::INFOBOX),
+    answer(templates::ANSWER),
+    categories(templates::CATEGORIES),
+    disambiguation(templates::DISAMBIGUATION),
+    empty(templates::EMPTY) {
+}
@@ -0,0 +1,81 @@
+#include <scope/scheduler.h>
+
+using namespace std;
+using namespace api;
+using namespace scope;
+
+Scheduler::Scheduler(Config::Ptr config) :
+    config_(config), next_id_(0), stopped_(false) {
+}
+
+uint64_t Scheduler::admit(const string &session, const Abort &abort) {
+    uint64_t id;
+    {
+        lock_guard<mutex> lock(mutex_);
+        auto &searches = sessions_[session];
+
+        // Whatever is still running for this session is stale now. Aborting
+        // under the lock makes sure the searches are still alive.
+        if (!session.empty()) {
+            for (const auto &search : searches) {
+                search.second();
+            }
+            searches.clear();
+        }
+
+        id = ++next_id_;
+        searches[id] = abort;
+    }
+
+    // Superseded searches waiting in #debounce can give up
+    changed_.notify_all();
+    return id;
+}
+
+bool Scheduler::debounce(const string &session, uint64_t id,
+                         const string &query) {
+    // Without a session, no newer search could take its place: waiting
+    // would only add latency
+    if (session.empty() || query.size() >= config_->debounce_prefix_length) {
+        return true;
+    }
+
+    unique_lock<mutex> lock(mutex_);
+    auto superseded = [this, &session, id]() {
+        auto it = sessions_.find(session);
+        return it == sessions_.end() || it->second.find(id) == it->second.end();
+    };
+    changed_.wait_for(lock, config_->debounce, [this, &superseded]() {
+        return stopped_ || superseded();
+    });
+    return !stopped_ && !superseded();
+}
+
+void Scheduler::finish(const string &session, uint64_t id) {
+    lock_guard<mutex> lock(mutex_);
+    auto it = sessions_.find(session);
+    if (it == sessions_.end()) {
+        return;
+    }
+    it->second.erase(id);
+    if (it->second.empty()) {
+        sessions_.erase(it);
+    }
+}
+
+size_t Scheduler::active() {
+    lock_guard<mutex> lock(mutex_);
+    size_t count = 0;
+    for (const auto &session : sessions_) {
+        count += session.second.size();
+    }
+    return count;
+}
+
+void Scheduler::stop() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        stopped_ = true;
+    }
+    changed_.notify_all();
+}
@@ -1,3 +1,5 @@
+#include <api/tracer.h>
+
 #include <scope/localization.h>
 #include <scope/preview.h>
 #include <scope/query.h>
@@ -13,7 +15,8 @@ using namespace api;
 using namespace scope;
 
 void Scope::start(string const&) {
-    config_ = make_shared<Config>();
+    context_ = make_shared<Context>();
+    context_->config = make_shared<Config>();
 
     setlocale(LC_ALL, "");
     string translation_directory = ScopeBase::scope_directory()
@@ -23,17 +26,99 @@ void Scope::start(string const&) {
     // Under test we set a different API root
     char *apiroot = getenv("NETWORK_SCOPE_APIROOT");
     if (apiroot) {
-        config_->apiroot = apiroot;
+        context_->config->apiroot = apiroot;
+    }
+
+    // Trace the searches, to see where the time of a slow one goes
+    char *trace = getenv("NETWORK_SCOPE_TRACE");
+    if (trace) {
+        Tracer::instance().enable(trace);
+    }
+
+    // Build the category renderers once, for all the queries
+    context_->renderers = make_shared<const Renderers>();
+
+    // Keep connections to the API alive across queries
+    context_->pool = make_shared<HttpPool>(context_->config);
+
+    // When the API is down, all the queries stop waiting for it together
+    context_->breaker = make_shared<CircuitBreaker>(context_->config);
+
+    // Build the homepage in background, opening the scope must be instant
+    context_->homepage = make_shared<Homepage>(context_->config,
+            context_->pool, context_->breaker);
+    context_->homepage->start();
+
+    // Identical queries running at the same time share their requests
+    context_->flights = make_shared<SingleFlight>(context_->config,
+            context_->pool, context_->breaker);
+
+    // While the user types, stale searches are aborted
+    context_->scheduler = make_shared<Scheduler>(context_->config);
+
+    // Remember the results of the latest queries
+    context_->cache = make_shared<ResultCache>(context_->config);
+
+    // And keep them on disk for the next time we are started. The file is
+    // only opened by the first search, so this is cheap.
+    try {
+        context_->disk_cache = make_shared<DiskCache>(context_->config,
+                ScopeBase::cache_directory() + "/results.log");
+    } catch (exception &e) {
+        cerr << "No cache directory, results are only cached in memory: "
+             << e.what() << endl;
+    }
+
+    // Fetch what the user is likely to search next, while nothing else runs
+    context_->prefetcher = make_shared<Prefetcher>(context_->config,
+            context_->flights, context_->scheduler, context_->cache,
+            context_->disk_cache);
+    context_->prefetcher->start();
+
+    // Let the node agent know how we are doing
+    try {
+        context_->stats = make_shared<Stats>(context_->config,
+                ScopeBase::cache_directory() + "/stats.prom", context_->pool,
+                context_->breaker, context_->cache);
+        context_->stats->start();
+    } catch (exception &e) {
+        cerr << "No cache directory, stats are not written: " << e.what()
+             << endl;
     }
 }
 
 void Scope::stop() {
+    if (!context_) {
+        return;
+    }
+    if (context_->homepage) {
+        context_->homepage->stop();
+    }
+    if (context_->prefetcher) {
+        context_->prefetcher->stop();
+    }
+    if (context_->flights) {
+        context_->flights->stop();
+    }
+    if (context_->scheduler) {
+        context_->scheduler->stop();
+    }
+    if (context_->pool) {
+        context_->pool->stop();
+    }
+    if (context_->stats) {
+        context_->stats->stop();
+    }
+    if (context_->disk_cache) {
+        context_->disk_cache->stop();
+    }
+    Tracer::instance().flush();
 }
 
 sc::SearchQueryBase::UPtr Scope::search(const sc::CannedQuery &query,
                                         const sc::SearchMetadata &metadata) {
     // Boilerplate construction of Query
-    return sc::SearchQueryBase::UPtr(new Query(query, metadata, config_));
+    return sc::SearchQueryBase::UPtr(new Query(query, metadata, context_));
 }
 
 sc::PreviewQueryBase::UPtr Scope::preview(sc::Result const& result,
@@ -0,0 +1,111 @@
+#include <scope/stats.h>
+
+#include <api/metrics.h>
+#include <api/tracer.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+using namespace api;
+using namespace scope;
+
+Stats::Stats(Config::Ptr config, const string &path, HttpPool::Ptr pool,
+             CircuitBreaker::Ptr breaker, ResultCache::Ptr cache) :
+    config_(config), path_(path), pool_(pool), breaker_(breaker),
+    cache_(cache), stopped_(false) {
+}
+
+Stats::~Stats() {
+    stop();
+}
+
+void Stats::start() {
+    worker_ = thread(&Stats::run, this);
+}
+
+void Stats::stop() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        if (stopped_) {
+            return;
+        }
+        stopped_ = true;
+    }
+    wake_.notify_all();
+
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+void Stats::write(ostream &out) {
+    Metrics::instance().write(out);
+
+    if (pool_) {
+        Metrics::write(out, "connection_waits_total",
+                       "Requests which waited for a connection to their host",
+                       "counter", pool_->waited());
+        Metrics::write(out, "hedged_total",
+                       "Requests sent again as they were slow", "counter",
+                       pool_->hedged());
+        Metrics::write(out, "hedge_wins_total",
+                       "Hedged requests answered first by the duplicate",
+                       "counter", pool_->hedge_wins());
+    }
+    if (breaker_) {
+        Metrics::write(out, "breaker_state",
+                       "Circuit breaker: 0 closed, 1 open, 2 half-open",
+                       "gauge", static_cast<int>(breaker_->state()));
+        Metrics::write(out, "breaker_rejected_total",
+                       "Requests failed fast by the circuit breaker",
+                       "counter", breaker_->rejected());
+    }
+    if (cache_) {
+        Metrics::write(out, "cache_entries", "Query results kept in memory",
+                       "gauge", cache_->size());
+    }
+}
+
+bool Stats::flush() {
+    // Write it aside and move it in place, readers see either the old or the
+    // new file
+    string tmp = path_ + ".tmp";
+    {
+        ofstream out(tmp, ios::trunc);
+        write(out);
+        if (!out.flush()) {
+            return false;
+        }
+    }
+    return rename(tmp.c_str(), path_.c_str()) == 0;
+}
+
+void Stats::run() {
+    unique_lock<mutex> lock(mutex_);
+
+    for (;;) {
+        wake_.wait_for(lock, config_->stats_interval, [this]() {
+            return stopped_;
+        });
+        bool stopped = stopped_;
+        lock.unlock();
+
+        if (!flush()) {
+            cerr << "Can't write the stats to " << path_ << endl;
+        }
+
+        // The scope is usually killed rather than stopped: the trace must be
+        // on disk by then
+        Tracer &tracer = Tracer::instance();
+        if (tracer.enabled() && !tracer.flush()) {
+            cerr << "Can't write the trace" << endl;
+        }
+
+        lock.lock();
+        if (stopped) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,19 @@
+#include <scope/topic.h>
+
+#include <api/markup.h>
+
+using namespace std;
+using namespace api;
+using namespace scope;
+
+Topic Topic::parse(boost::string_ref result, boost::string_ref separator) {
+    Markup::Anchor anchor = Markup::anchor(result);
+
+    Topic topic;
+    topic.title = anchor.title;
+    topic.summary = anchor.text;
+    if (topic.summary.starts_with(separator)) {
+        topic.summary.remove_prefix(separator.size());
+    }
+    return topic;
+}
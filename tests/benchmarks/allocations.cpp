@@ -0,0 +1,37 @@
+#include "fixtures.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+
+/**
+ * Every allocation of the benchmarks, counted by replacing the global
+ * operator new
+ */
+static atomic<uint64_t> allocated(0);
+
+void *operator new(size_t size) {
+    allocated.fetch_add(1, memory_order_relaxed);
+    if (void *p = malloc(size ? size : 1)) {
+        return p;
+    }
+    throw bad_alloc();
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    free(p);
+}
+
+uint64_t benchmarks::allocations() {
+    return allocated.load(memory_order_relaxed);
+}
@@ -0,0 +1,153 @@
+#include <api/decoder.h>
+
+#include "../fixtures.h"
+
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <QJsonDocument>
+#include <QVariantMap>
+
+using namespace std;
+using namespace api;
+
+/**
+ * Keep the benchmarks in an anonymous namespace
+ */
+namespace {
+
+using benchmarks::fixture;
+
+/**
+ * The way responses were decoded before the streaming decoder: a full
+ * QJsonDocument, converted to a QVariant tree, converted to std::string, here
+ * stored in the arena
+ */
+void qt_decode(const string &body, Client::QueryResults &results) {
+    QVariantMap variant = QJsonDocument::fromJson(body.c_str()).toVariant().toMap();
+    Arena &arena = results.arena;
+    auto text = [&arena](const QVariant &value) {
+        return arena.store(value.toString().toStdString());
+    };
+
+    results.abstract.summary = text(variant["Abstract"]);
+    results.abstract.textSummary = text(variant["AbstractText"]);
+    results.abstract.source = text(variant["AbstractSource"]);
+    results.abstract.url = text(variant["AbstractURL"]);
+    results.abstract.imageUrl = text(variant["Image"]);
+    results.abstract.heading = text(variant["Heading"]);
+    results.answer.instantAnswer = text(variant["Answer"]);
+    results.answer.type = text(variant["AnswerType"]);
+    results.definition.definition = text(variant["Definition"]);
+    results.definition.source = text(variant["DefinitionSource"]);
+    results.definition.url = text(variant["DefinitionURL"]);
+    results.type = text(variant["Type"]);
+
+    QVariantMap infobox = variant["Infobox"].toMap();
+    for (const QVariant &c : infobox["content"].toList()) {
+        QVariantMap item = c.toMap();
+        results.infobox.emplace_back(
+            Client::Content {
+                text(item["data_type"]),
+                text(item["value"]),
+                text(item["label"]),
+                item["wiki_order"].toUInt()
+            }
+        );
+    }
+
+    for (const QVariant &r : variant["RelatedTopics"].toList()) {
+        QVariantMap result = r.toMap();
+        QVariantMap icon = result["Icon"].toMap();
+        results.relatedTopics.emplace_back(
+            Client::Result {
+                text(result["Result"]),
+                text(result["FirstURL"]),
+                Client::Icon {
+                    text(icon["URL"]),
+                    icon["Width"].toUInt(),
+                    icon["Height"].toUInt()
+                },
+                text(result["Text"])
+            }
+        );
+    }
+}
+
+void BM_Decoder(benchmark::State &state, const char *name) {
+    string body = fixture(name);
+    uint64_t before = benchmarks::allocations(), copied = 0;
+    for (auto _ : state) {
+        Client::QueryResults results;
+        Decoder::decode(body.data(), body.size(), results);
+        benchmark::DoNotOptimize(results);
+        copied += results.arena.size();
+    }
+    benchmarks::report_allocations(state, benchmarks::allocations() - before);
+    state.counters["copied"] = benchmark::Counter(
+            static_cast<double>(copied), benchmark::Counter::kAvgIterations);
+    state.SetBytesProcessed(state.iterations() * body.size());
+}
+
+/**
+ * Decoding a response we own, as Client::get does: the body moves in the
+ * results, so there is nothing to copy. Each iteration gets a fresh body, as
+ * the transport would, which is not timed.
+ */
+void BM_DecoderInPlace(benchmark::State &state, const char *name) {
+    string body = fixture(name);
+    uint64_t allocated = 0, copied = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        string document = body;
+        uint64_t before = benchmarks::allocations();
+        state.ResumeTiming();
+
+        Client::QueryResults results;
+        Decoder::decode(move(document), results);
+        benchmark::DoNotOptimize(results);
+
+        state.PauseTiming();
+        allocated += benchmarks::allocations() - before;
+        copied += results.arena.size();
+        state.ResumeTiming();
+    }
+    benchmarks::report_allocations(state, allocated);
+    state.counters["copied"] = benchmark::Counter(
+            static_cast<double>(copied), benchmark::Counter::kAvgIterations);
+    state.SetBytesProcessed(state.iterations() * body.size());
+}
+
+void BM_QJsonDocument(benchmark::State &state, const char *name) {
+    string body = fixture(name);
+    uint64_t before = benchmarks::allocations();
+    for (auto _ : state) {
+        Client::QueryResults results;
+        qt_decode(body, results);
+        benchmark::DoNotOptimize(results);
+    }
+    benchmarks::report_allocations(state, benchmarks::allocations() - before);
+    state.SetBytesProcessed(state.iterations() * body.size());
+}
+
+BENCHMARK_CAPTURE(BM_Decoder, answer, "answer");
+BENCHMARK_CAPTURE(BM_DecoderInPlace, answer, "answer");
+BENCHMARK_CAPTURE(BM_QJsonDocument, answer, "answer");
+BENCHMARK_CAPTURE(BM_Decoder, article, "article");
+BENCHMARK_CAPTURE(BM_DecoderInPlace, article, "article");
+BENCHMARK_CAPTURE(BM_QJsonDocument, article, "article");
+BENCHMARK_CAPTURE(BM_Decoder, disambiguation, "disambiguation");
+BENCHMARK_CAPTURE(BM_DecoderInPlace, disambiguation, "disambiguation");
+BENCHMARK_CAPTURE(BM_QJsonDocument, disambiguation, "disambiguation");
+BENCHMARK_CAPTURE(BM_Decoder, category, "category");
+BENCHMARK_CAPTURE(BM_DecoderInPlace, category, "category");
+BENCHMARK_CAPTURE(BM_QJsonDocument, category, "category");
+BENCHMARK_CAPTURE(BM_Decoder, large_infobox, "large-infobox");
+BENCHMARK_CAPTURE(BM_DecoderInPlace, large_infobox, "large-infobox");
+BENCHMARK_CAPTURE(BM_QJsonDocument, large_infobox, "large-infobox");
+BENCHMARK_CAPTURE(BM_Decoder, large_disambiguation, "large-disambiguation");
+BENCHMARK_CAPTURE(BM_DecoderInPlace, large_disambiguation, "large-disambiguation");
+BENCHMARK_CAPTURE(BM_QJsonDocument, large_disambiguation, "large-disambiguation");
+
+} // namespace
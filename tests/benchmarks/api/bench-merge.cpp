@@ -0,0 +1,53 @@
+#include <api/client.h>
+
+#include "../fixtures.h"
+
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <utility>
+
+using namespace std;
+using namespace api;
+
+/**
+ * Keep the benchmarks in an anonymous namespace
+ */
+namespace {
+
+/**
+ * Merge the responses to the two forms of a query, as Client::queryResults
+ * does. The merge takes the other document apart, so each iteration starts
+ * from fresh copies, which are not timed.
+ */
+void BM_Merge(benchmark::State &state, const char *ours, const char *theirs) {
+    Client::QueryResults withQ = benchmarks::results(ours);
+    Client::QueryResults withoutQ = benchmarks::results(theirs);
+
+    uint64_t allocated = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        Client::QueryResults results = withQ.copy();
+        Client::QueryResults other = withoutQ.copy();
+        uint64_t before = benchmarks::allocations();
+        state.ResumeTiming();
+
+        results.merge(move(other));
+        benchmark::DoNotOptimize(results);
+
+        state.PauseTiming();
+        allocated += benchmarks::allocations() - before;
+        state.ResumeTiming();
+    }
+    benchmarks::report_allocations(state, allocated);
+}
+
+// An answer completed by the abstract of the other form
+BENCHMARK_CAPTURE(BM_Merge, answer_article, "answer", "article");
+// Nothing to take: both forms have the same fields
+BENCHMARK_CAPTURE(BM_Merge, article_article, "article", "article");
+// Most of the fields come from a large response of the other form
+BENCHMARK_CAPTURE(BM_Merge, answer_large_infobox, "answer", "large-infobox");
+BENCHMARK_CAPTURE(BM_Merge, answer_large_disambiguation, "answer",
+                  "large-disambiguation");
+
+} // namespace
@@ -0,0 +1,51 @@
+#ifndef BENCHMARKS_FIXTURES_H_
+#define BENCHMARKS_FIXTURES_H_
+
+#include <api/client.h>
+#include <api/decoder.h>
+
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace benchmarks {
+
+/**
+ * Number of allocations so far, on all the threads
+ */
+std::uint64_t allocations();
+
+/**
+ * Report the allocations made by all the iterations, as an average per
+ * iteration
+ */
+inline void report_allocations(benchmark::State &state, std::uint64_t allocated) {
+    state.counters["allocs"] = benchmark::Counter(
+            static_cast<double>(allocated), benchmark::Counter::kAvgIterations);
+}
+
+/**
+ * Load a recorded DuckDuckGo response
+ */
+inline std::string fixture(const std::string &name) {
+    std::ifstream file(std::string(DDG_FIXTURES) + "/" + name + ".json");
+    std::stringstream content;
+    content << file.rdbuf();
+    return content.str();
+}
+
+/**
+ * Load and decode a recorded DuckDuckGo response
+ */
+inline api::Client::QueryResults results(const std::string &name) {
+    std::string body = fixture(name);
+    api::Client::QueryResults results;
+    api::Decoder::decode(body.data(), body.size(), results);
+    return results;
+}
+
+}
+
+#endif // BENCHMARKS_FIXTURES_H_
@@ -0,0 +1,85 @@
+#include <scope/context.h>
+#include <scope/query.h>
+
+#include "../fixtures.h"
+
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <gmock/gmock.h>
+#include <memory>
+#include <unity/scopes/CannedQuery.h>
+#include <unity/scopes/SearchMetadata.h>
+#include <unity/scopes/SearchReply.h>
+#include <unity/scopes/testing/Category.h>
+#include <unity/scopes/testing/MockSearchReply.h>
+
+using namespace std;
+using namespace testing;
+using namespace api;
+using namespace scope;
+
+namespace sc = unity::scopes;
+namespace sct = unity::scopes::testing;
+
+/**
+ * Keep the benchmarks in an anonymous namespace
+ */
+namespace {
+
+/**
+ * The shared state of the scope, without the network: the results are
+ * already in the cache
+ */
+Context::Ptr warm_context(const string &query, const char *name) {
+    auto context = make_shared<Context>();
+    context->config = make_shared<Config>();
+    context->renderers = make_shared<const Renderers>();
+    context->breaker = make_shared<CircuitBreaker>(context->config);
+    context->flights = make_shared<SingleFlight>(context->config,
+            HttpPool::Ptr(), context->breaker);
+    context->scheduler = make_shared<Scheduler>(context->config);
+    context->cache = make_shared<ResultCache>(context->config);
+
+    context->cache->put(query, make_shared<const Client::QueryResults>(
+            benchmarks::results(name)));
+    return context;
+}
+
+/**
+ * A whole search answered from the cache: rendering the cards and handing
+ * them to a reply which throws them away
+ */
+void BM_QueryRun(benchmark::State &state, const char *name) {
+    string query_string = name;
+    Context::Ptr context = warm_context(query_string, name);
+
+    const sc::CategoryRenderer renderer;
+    NiceMock<sct::MockSearchReply> reply;
+    ON_CALL(reply, register_category(_, _, _, _)).WillByDefault(Invoke(
+            [&renderer](const string &id, const string &title,
+                        const string &icon, const sc::CategoryRenderer &) {
+        return make_shared<sct::Category>(id, title, icon, renderer);
+    }));
+    ON_CALL(reply, push(Matcher<sc::CategorisedResult const&>(_)))
+            .WillByDefault(Return(true));
+    sc::SearchReplyProxy reply_proxy(&reply, [](sc::SearchReply*) {});
+
+    sc::CannedQuery query(SCOPE_NAME, query_string, "");
+    sc::SearchMetadata metadata("en_US", "desktop");
+
+    // The mock reply allocates too, to record the calls
+    uint64_t before = benchmarks::allocations();
+    for (auto _ : state) {
+        Query search(query, metadata, context);
+        search.run(reply_proxy);
+    }
+    benchmarks::report_allocations(state, benchmarks::allocations() - before);
+}
+
+BENCHMARK_CAPTURE(BM_QueryRun, answer, "answer");
+BENCHMARK_CAPTURE(BM_QueryRun, article, "article");
+BENCHMARK_CAPTURE(BM_QueryRun, category, "category");
+BENCHMARK_CAPTURE(BM_QueryRun, large_infobox, "large-infobox");
+BENCHMARK_CAPTURE(BM_QueryRun, large_disambiguation, "large-disambiguation");
+
+} // namespace
@@ -0,0 +1,38 @@
+#include <scope/topic.h>
+
+#include "../fixtures.h"
+
+#include <benchmark/benchmark.h>
+
+using namespace std;
+using namespace api;
+using namespace scope;
+
+/**
+ * Keep the benchmarks in an anonymous namespace
+ */
+namespace {
+
+/**
+ * Take the title and the summary out of the HTML of all the related topics
+ * of a response, as the category and disambiguation cards do
+ */
+void BM_Topic(benchmark::State &state, const char *name,
+              const char *separator) {
+    Client::QueryResults results = benchmarks::results(name);
+
+    for (auto _ : state) {
+        for (const auto &content : results.relatedTopics) {
+            Topic topic = Topic::parse(content.result, separator);
+            benchmark::DoNotOptimize(topic);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * results.relatedTopics.size());
+}
+
+BENCHMARK_CAPTURE(BM_Topic, category, "category", " - ");
+BENCHMARK_CAPTURE(BM_Topic, disambiguation, "disambiguation", "");
+BENCHMARK_CAPTURE(BM_Topic, large_disambiguation, "large-disambiguation",
+                  "");
+
+} // namespace
@@ -0,0 +1,518 @@
+#include <scope/scope.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <core/posix/exec.h>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <getopt.h>
+#include <gmock/gmock.h>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <unity/scopes/CannedQuery.h>
+#include <unity/scopes/SearchMetadata.h>
+#include <unity/scopes/SearchReply.h>
+#include <unity/scopes/testing/Category.h>
+#include <unity/scopes/testing/MockSearchReply.h>
+#include <unity/scopes/testing/TypedScopeFixture.h>
+#include <vector>
+
+using namespace std;
+using namespace testing;
+using namespace scope;
+
+namespace posix = core::posix;
+namespace sc = unity::scopes;
+namespace sct = unity::scopes::testing;
+
+/**
+ * Every allocation of the process, counted to tell the allocations per query
+ */
+static atomic<uint64_t> allocations(0);
+
+void *operator new(size_t size) {
+    allocations.fetch_add(1, memory_order_relaxed);
+    if (void *p = malloc(size ? size : 1)) {
+        return p;
+    }
+    throw bad_alloc();
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    free(p);
+}
+
+/**
+ * Keep the load generator in an anonymous namespace
+ */
+namespace {
+
+typedef chrono::steady_clock Clock;
+
+struct Options {
+    /* number of searches running at the same time */
+    unsigned threads = 8;
+
+    /* how long to keep the load on */
+    chrono::seconds duration { 10 };
+
+    /* fraction of the searches cancelled by the shell */
+    double cancel_rate = 0.05;
+
+    /* the cancellations come at a random time up to this */
+    chrono::milliseconds cancel_after { 200 };
+
+    /* fraction of the searches made unique, so they miss the caches */
+    double unique_rate = 0.2;
+
+    /* latency and faults of the fake server, see tests/server/faults.json */
+    string faults;
+
+    /* the searches to replay, see mix.txt */
+    string mix = LOADGEN_MIX;
+
+    /* use this API root instead of starting the fake server */
+    string apiroot;
+
+    unsigned seed = 42;
+};
+
+void usage(const char *name) {
+    cerr << "Usage: " << name << " [OPTION]..." << endl
+         << "Run concurrent searches against the scope, and report how it copes."
+         << endl << endl
+         << "  --threads=N        searches running at the same time (8)" << endl
+         << "  --duration=S       seconds of load (10)" << endl
+         << "  --cancel-rate=F    fraction of the searches cancelled (0.05)" << endl
+         << "  --cancel-after=MS  cancel at a random time up to MS (200)" << endl
+         << "  --unique-rate=F    fraction of the searches missing the caches (0.2)" << endl
+         << "  --faults=FILE      latency and faults of the fake server" << endl
+         << "  --mix=FILE         weights and search strings to replay" << endl
+         << "  --apiroot=URL      use this server instead of the fake one" << endl
+         << "  --seed=N           seed of the random choices (42)" << endl;
+}
+
+bool parse(int argc, char **argv, Options &options) {
+    static const struct option long_options[] = {
+        { "threads", required_argument, nullptr, 't' },
+        { "duration", required_argument, nullptr, 'd' },
+        { "cancel-rate", required_argument, nullptr, 'c' },
+        { "cancel-after", required_argument, nullptr, 'a' },
+        { "unique-rate", required_argument, nullptr, 'u' },
+        { "faults", required_argument, nullptr, 'f' },
+        { "mix", required_argument, nullptr, 'm' },
+        { "apiroot", required_argument, nullptr, 'r' },
+        { "seed", required_argument, nullptr, 's' },
+        { "help", no_argument, nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 }
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "", long_options, nullptr)) != -1) {
+        switch (c) {
+        case 't':
+            options.threads = max(1, atoi(optarg));
+            break;
+        case 'd':
+            options.duration = chrono::seconds(atoi(optarg));
+            break;
+        case 'c':
+            options.cancel_rate = atof(optarg);
+            break;
+        case 'a':
+            options.cancel_after = chrono::milliseconds(atoi(optarg));
+            break;
+        case 'u':
+            options.unique_rate = atof(optarg);
+            break;
+        case 'f':
+            options.faults = optarg;
+            break;
+        case 'm':
+            options.mix = optarg;
+            break;
+        case 'r':
+            options.apiroot = optarg;
+            break;
+        case 's':
+            options.seed = atoi(optarg);
+            break;
+        default:
+            return false;
+        }
+    }
+    return optind == argc;
+}
+
+/**
+ * The search strings to replay, each one picked as often as its weight says
+ */
+class Mix {
+public:
+    explicit Mix(const string &path) {
+        ifstream file(path);
+        if (!file) {
+            throw domain_error("Cannot read the query mix: " + path);
+        }
+
+        vector<double> weights;
+        string line;
+        while (getline(file, line)) {
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+
+            istringstream fields(line);
+            double weight = 0;
+            fields >> weight >> ws;
+            string query;
+            getline(fields, query);
+
+            weights.emplace_back(weight);
+            queries_.emplace_back(query);
+        }
+
+        if (queries_.empty()) {
+            throw domain_error("Empty query mix: " + path);
+        }
+        pick_ = discrete_distribution<size_t>(weights.begin(), weights.end());
+    }
+
+    const string &pick(mt19937 &random) {
+        return queries_[pick_(random)];
+    }
+
+protected:
+    vector<string> queries_;
+
+    discrete_distribution<size_t> pick_;
+};
+
+/**
+ * Cancels searches from another thread, as the shell does when the user
+ * types on
+ */
+class Canceller {
+public:
+    /**
+     * A search which may be cancelled before it finishes
+     */
+    struct Ticket {
+        typedef shared_ptr<Ticket> Ptr;
+
+        explicit Ticket(shared_ptr<sc::SearchQueryBase> search) :
+            search(search) {
+        }
+
+        /**
+         * Returns true if the search was cancelled before finishing
+         */
+        bool finish() {
+            lock_guard<mutex> lock(guard);
+            done = true;
+            return cancelled;
+        }
+
+        shared_ptr<sc::SearchQueryBase> search;
+
+        /**
+         * Guards #done and #cancelled
+         */
+        mutex guard;
+
+        bool done = false;
+
+        bool cancelled = false;
+    };
+
+    Canceller() :
+        thread_(&Canceller::loop, this) {
+    }
+
+    ~Canceller() {
+        {
+            lock_guard<mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+    }
+
+    void schedule(Clock::time_point when, Ticket::Ptr ticket) {
+        {
+            lock_guard<mutex> lock(mutex_);
+            tickets_.emplace(when, ticket);
+        }
+        wake_.notify_one();
+    }
+
+protected:
+    void loop() {
+        unique_lock<mutex> lock(mutex_);
+        while (!stopping_) {
+            if (tickets_.empty()) {
+                wake_.wait(lock);
+                continue;
+            }
+
+            auto first = tickets_.begin();
+            if (Clock::now() < first->first) {
+                wake_.wait_until(lock, first->first);
+                continue;
+            }
+
+            Ticket::Ptr ticket = first->second;
+            tickets_.erase(first);
+
+            // Searches which already finished have nothing to cancel
+            lock.unlock();
+            {
+                lock_guard<mutex> ticket_lock(ticket->guard);
+                if (!ticket->done) {
+                    ticket->cancelled = true;
+                    ticket->search->cancelled();
+                }
+            }
+            lock.lock();
+        }
+    }
+
+    mutex mutex_;
+
+    condition_variable wake_;
+
+    multimap<Clock::time_point, Ticket::Ptr> tickets_;
+
+    bool stopping_ = false;
+
+    thread thread_;
+};
+
+/**
+ * What a worker has seen
+ */
+struct Tally {
+    /* durations of the searches which ran to the end, in microseconds */
+    vector<uint64_t> latencies;
+
+    uint64_t cancelled = 0;
+
+    uint64_t failed = 0;
+};
+
+/**
+ * Loads the scope with the same runtime stand-ins as the unit tests
+ */
+class Harness: public sct::TypedScopeFixture<Scope> {
+public:
+    using sct::TypedScopeFixture<Scope>::SetUp;
+
+    using sct::TypedScopeFixture<Scope>::TearDown;
+
+    void TestBody() override {
+    }
+
+    Scope &get() {
+        return *scope;
+    }
+};
+
+/**
+ * Run searches one after the other until the deadline.
+ *
+ * Each worker has its own copy of the mix, and its own reply: the mock
+ * allocates to record the calls, which adds a few allocations to each
+ * search.
+ */
+void work(unsigned index, const Options &options, Mix mix, Scope &scope,
+          Canceller &canceller, Clock::time_point deadline, Tally &tally) {
+    mt19937 random(options.seed + index);
+    uniform_real_distribution<double> chance(0.0, 1.0);
+    uniform_int_distribution<long> cancel_after(0, options.cancel_after.count());
+
+    // Discard the cards, as quickly as the shell would take them
+    const sc::CategoryRenderer renderer;
+    NiceMock<sct::MockSearchReply> reply;
+    ON_CALL(reply, register_category(_, _, _, _)).WillByDefault(Invoke(
+            [&renderer](const string &id, const string &title,
+                        const string &icon, const sc::CategoryRenderer &) {
+        return make_shared<sct::Category>(id, title, icon, renderer);
+    }));
+    ON_CALL(reply, push(Matcher<sc::CategorisedResult const&>(_)))
+            .WillByDefault(Return(true));
+    sc::SearchReplyProxy reply_proxy(&reply, [](sc::SearchReply*) {});
+
+    // Each worker is a different shell, so they don't supersede each other
+    string session = "loadgen-" + to_string(index);
+    uint64_t unique = 0;
+
+    tally.latencies.reserve(1 << 16);
+    while (Clock::now() < deadline) {
+        string query_string = mix.pick(random);
+        // The fake server answers it as the query without the suffix
+        if (!query_string.empty() && chance(random) < options.unique_rate) {
+            query_string += " " + session + "-" + to_string(unique++);
+        }
+
+        sc::CannedQuery query(SCOPE_NAME, query_string, "");
+        sc::SearchMetadata metadata("en_US", "phone");
+        metadata.set_hint("session-id", sc::Variant(session));
+
+        auto started = Clock::now();
+        try {
+            auto ticket = make_shared<Canceller::Ticket>(
+                    shared_ptr<sc::SearchQueryBase>(scope.search(query, metadata)));
+            if (chance(random) < options.cancel_rate) {
+                canceller.schedule(
+                        started + chrono::milliseconds(cancel_after(random)),
+                        ticket);
+            }
+
+            ticket->search->run(reply_proxy);
+
+            if (ticket->finish()) {
+                ++tally.cancelled;
+                continue;
+            }
+        } catch (exception &e) {
+            cerr << "Search '" << query_string << "' failed: " << e.what() << endl;
+            ++tally.failed;
+            continue;
+        }
+
+        tally.latencies.emplace_back(
+                chrono::duration_cast<chrono::microseconds>(
+                    Clock::now() - started).count());
+    }
+}
+
+/**
+ * The q quantile (between 0 and 1) of sorted latencies, in milliseconds
+ */
+double percentile(const vector<uint64_t> &sorted, double q) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t i = min(sorted.size() - 1, size_t(q * sorted.size()));
+    return sorted[i] / 1000.0;
+}
+
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parse(argc, argv, options)) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    try {
+        Mix mix(options.mix);
+
+        // Start up Python-based fake DuckDuckGo server, unless we are told
+        // where the API is
+        posix::ChildProcess fake_server = posix::ChildProcess::invalid();
+        string apiroot = options.apiroot;
+        if (apiroot.empty()) {
+            vector<string> args { FAKE_SERVER, "--seed", to_string(options.seed) };
+            if (!options.faults.empty()) {
+                args.emplace_back("--config");
+                args.emplace_back(options.faults);
+            }
+            fake_server = posix::exec("/usr/bin/python3", args, { },
+                                      posix::StandardStream::stdout);
+
+            // The server will print out the random port it is using
+            string port;
+            fake_server.cout() >> port;
+            if (port.empty()) {
+                throw domain_error("The fake server didn't start");
+            }
+            apiroot = "http://127.0.0.1:" + port;
+        }
+        setenv("NETWORK_SCOPE_APIROOT", apiroot.c_str(), true);
+
+        Harness harness;
+        Harness::set_scope_directory(TEST_SCOPE_DIRECTORY);
+        harness.SetUp();
+
+        vector<Tally> tallies(options.threads);
+        uint64_t allocations_before;
+        chrono::duration<double> elapsed;
+        {
+            Canceller canceller;
+            vector<thread> workers;
+
+            allocations_before = allocations.load();
+            auto started = Clock::now();
+            auto deadline = started + options.duration;
+            for (unsigned i = 0; i < options.threads; ++i) {
+                workers.emplace_back(work, i, cref(options), mix,
+                                     ref(harness.get()), ref(canceller),
+                                     deadline, ref(tallies[i]));
+            }
+            for (auto &worker : workers) {
+                worker.join();
+            }
+            elapsed = Clock::now() - started;
+        }
+        uint64_t allocated = allocations.load() - allocations_before;
+
+        harness.TearDown();
+
+        vector<uint64_t> latencies;
+        uint64_t cancelled = 0, failed = 0;
+        for (auto &tally : tallies) {
+            latencies.insert(latencies.end(), tally.latencies.begin(),
+                             tally.latencies.end());
+            cancelled += tally.cancelled;
+            failed += tally.failed;
+        }
+        sort(latencies.begin(), latencies.end());
+        uint64_t searches = latencies.size() + cancelled + failed;
+
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+
+        cout << fixed << setprecision(2)
+             << "threads:          " << options.threads << endl
+             << "duration:         " << elapsed.count() << " s" << endl
+             << "searches:         " << searches << " (" << cancelled
+             << " cancelled, " << failed << " failed)" << endl
+             << "throughput:       " << searches / elapsed.count() << " QPS" << endl
+             << "latency p50:      " << percentile(latencies, 0.50) << " ms" << endl
+             << "latency p90:      " << percentile(latencies, 0.90) << " ms" << endl
+             << "latency p99:      " << percentile(latencies, 0.99) << " ms" << endl
+             << "latency p99.9:    " << percentile(latencies, 0.999) << " ms" << endl
+             << "latency max:      " << percentile(latencies, 1.0) << " ms" << endl
+             << "peak RSS:         " << usage.ru_maxrss / 1024.0 << " MiB" << endl
+             << "allocations:      "
+             << (searches ? double(allocated) / searches : 0.0)
+             << " per search" << endl;
+    } catch (exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -1,10 +1,35 @@
 #!/usr/bin/env python3
 
+"""
+Stand-in for api.duckduckgo.com, replaying recorded responses.
+
+It answers the two forms of query the scope sends, /?q=QUERY and /QUERY,
+with the fixtures in ddg/: ddg/queries.json tells which fixture answers each
+query in each form, unknown queries get the empty response. The suffix
+scope-loadgen adds to make a query miss the caches, like
+"python loadgen-3-17", is ignored.
+
+Requests are served concurrently, on keep-alive connections. To test how the
+scope copes with a slow or faulty API, each form can be given a latency
+distribution, an error rate and a rate of truncated bodies, with a JSON file
+passed to --config (see faults.json). With --seed, the faults of a request
+only depend on the seed, its path and how many times the path was asked
+before, whatever the threads do.
+
+The random port it listens on is printed on stdout.
+"""
+
+import argparse
 import http.server
+import json
 import os
+import random
+import re
 import socketserver
 import sys
-from urllib.parse import urlparse,parse_qs
+import threading
+import time
+from urllib.parse import urlparse, parse_qs, unquote
 
 def read_file(path):
     file = os.path.join(os.path.dirname(__file__), path)
@@ -16,48 +41,155 @@ def read_file(path):
 
     return content
 
-class MyRequestHandler(http.server.BaseHTTPRequestHandler):
-    def do_GET(self):
-        sys.stderr.write("GET: %s\n" % self.path)
-        sys.stderr.flush()
+def normalize(query):
+    return ' '.join(query.lower().split())
+
+# Added by scope-loadgen to a query so it misses the caches of the scope
+LOADGEN_SUFFIX = re.compile(r' loadgen-\d+-\d+$')
+
+class Corpus:
+    """
+    The fixtures, loaded once: the handlers only read them
+    """
+    def __init__(self):
+        self.queries = {normalize(query): forms for query, forms
+                        in json.loads(read_file('ddg/queries.json')).items()}
+        self.bodies = {}
+        for forms in self.queries.values():
+            for name in forms.values():
+                self.bodies[name] = bytes(read_file('ddg/%s.json' % name), 'UTF-8')
+        self.empty = bytes(read_file('ddg/empty.json'), 'UTF-8')
+
+    def body(self, form, query):
+        forms = self.queries.get(LOADGEN_SUFFIX.sub('', normalize(query)), {})
+        return self.bodies.get(forms.get(form), self.empty)
+
+class Route:
+    """
+    How a form of query misbehaves
+    """
+    def __init__(self, settings):
+        self.latency = settings.get('latency', {'distribution': 'fixed', 'ms': 0})
+        self.error_rate = settings.get('error_rate', 0.0)
+        self.error_status = settings.get('error_status', 503)
+        self.truncate_rate = settings.get('truncate_rate', 0.0)
+
+    def delay(self, rng):
+        """
+        Seconds to wait before answering
+        """
+        latency = self.latency
+        distribution = latency.get('distribution', 'fixed')
+        if distribution == 'fixed':
+            ms = latency.get('ms', 0)
+        elif distribution == 'uniform':
+            ms = rng.uniform(latency['min_ms'], latency['max_ms'])
+        elif distribution == 'lognormal':
+            # A long tail, like the real API: most requests close to the
+            # median, a few much slower
+            ms = latency['median_ms'] * rng.lognormvariate(0, latency.get('sigma', 0.5))
+        elif distribution == 'exponential':
+            ms = rng.expovariate(1.0 / latency['mean_ms'])
+        else:
+            raise ValueError('Unknown latency distribution: %s' % distribution)
+        return max(ms, 0) / 1000.0
+
+def load_routes(path):
+    settings = {}
+    if path:
+        with open(path, 'r') as fp:
+            settings = json.load(fp)
+
+    default = settings.get('default', {})
+    return {form: Route(dict(default, **settings.get(form, {})))
+            for form in ('query', 'path')}
+
+class Randomness:
+    """
+    The random source of each request. The handlers run on threads of their
+    own, so with a seed each request gets a generator of its own, derived from
+    the seed, its path and a count of the requests for that path.
+    """
+    def __init__(self, seed):
+        self.seed = seed
+        self.lock = threading.Lock()
+        self.counts = {}
+
+    def request(self, path):
+        if self.seed is None:
+            return random.Random()
+        with self.lock:
+            count = self.counts.get(path, 0)
+            self.counts[path] = count + 1
+        return random.Random('%d %s %d' % (self.seed, path, count))
+
+class DDGRequestHandler(http.server.BaseHTTPRequestHandler):
+    # Keep the connections alive, as the real API does
+    protocol_version = 'HTTP/1.1'
 
+    def do_GET(self):
+        rng = self.server.randomness.request(self.path)
         parse = urlparse(self.path)
-        path = parse.path
         query = parse_qs(parse.query)
-        
-        if path == '/data/2.5/weather':
-            self.send_response(200)
-            self.send_header("Content-type", "text/html")
-            self.end_headers()
 
-            mode = 'json'
-            if 'mode' in query:
-                mode = query['mode'][0]
+        # /?q=QUERY or /QUERY, where the path may go on with &format=json
+        if 'q' in query:
+            form, text = 'query', query['q'][0]
+        else:
+            form, text = 'path', unquote(parse.path[1:].split('&')[0])
+
+        route = self.server.routes[form]
+        time.sleep(route.delay(rng))
+
+        if rng.random() < route.error_rate:
+            self.send_body(route.error_status, bytes('ERROR', 'UTF-8'))
+            return
 
-            self.wfile.write(bytes(read_file('weather/%s.%s' % (query['q'][0], mode)), 'UTF-8'))
-        elif path == '/data/2.5/forecast/daily':
+        body = self.server.corpus.body(form, text)
+
+        if rng.random() < route.truncate_rate:
+            # Promise the whole body, then hang up halfway through it
             self.send_response(200)
-            self.send_header("Content-type", "text/html")
+            self.send_header("Content-type", "application/x-javascript")
+            self.send_header("Content-Length", str(len(body)))
             self.end_headers()
+            self.wfile.write(body[:len(body) // 2])
+            self.wfile.flush()
+            self.close_connection = True
+            return
 
-            mode = 'json'
-            if 'mode' in query:
-                mode = query['mode'][0]
+        self.send_body(200, body)
 
-            self.wfile.write(bytes(read_file('forecast/daily/%s.%s' % (query['q'][0], mode)), 'UTF-8'))
-        else:
-            self.send_response(404)
-            self.send_header("Content-type", "text/html")
-            self.end_headers()
-            self.wfile.write(bytes('ERROR', 'UTF-8'))
+    # The scope only looks at the body, whatever the method
+    do_HEAD = do_GET
+
+    def send_body(self, status, body):
+        self.send_response(status)
+        self.send_header("Content-type", "application/x-javascript")
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def log_message(self, format, *args):
+        pass
+
+class DDGServer(socketserver.ThreadingMixIn, http.server.HTTPServer):
+    daemon_threads = True
+    allow_reuse_address = True
 
 if __name__ == "__main__":
-    Handler = MyRequestHandler
-    httpd = socketserver.TCPServer(("127.0.0.1", 0), Handler)
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--config', help='latency and faults of each form of query')
+    parser.add_argument('--seed', type=int, help='seed of the random faults')
+    args = parser.parse_args()
+
+    httpd = DDGServer(("127.0.0.1", 0), DDGRequestHandler)
+    httpd.randomness = Randomness(args.seed)
+    httpd.corpus = Corpus()
+    httpd.routes = load_routes(args.config)
 
     sys.stdout.write('%d\n' % httpd.server_address[1])
     sys.stdout.flush()
 
     httpd.serve_forever()
-
-
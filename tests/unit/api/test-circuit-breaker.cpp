@@ -0,0 +1,149 @@
+#include <api/circuit_breaker.h>
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
+
+using namespace std;
+using namespace api;
+
+/**
+ * Keep the tests in an anonymous namespace
+ */
+namespace {
+
+typedef CircuitBreaker::State State;
+
+class TestCircuitBreaker: public ::testing::Test {
+protected:
+    void SetUp() override {
+        config_ = make_shared<Config>();
+        config_->breaker_failures = 3;
+        config_->breaker_backoff = chrono::milliseconds(40);
+        config_->breaker_max_backoff = chrono::milliseconds(80);
+        breaker_ = make_shared<CircuitBreaker>(config_);
+    }
+
+    /**
+     * Fail enough requests in a row to open the breaker
+     */
+    void trip() {
+        for (unsigned int i = 0; i < config_->breaker_failures; ++i) {
+            ASSERT_TRUE(breaker_->allow());
+            breaker_->failure();
+        }
+        ASSERT_EQ(State::open, breaker_->state());
+    }
+
+    /**
+     * Wait for the backoff to be over, and send the probe
+     */
+    void probe(chrono::milliseconds backoff) {
+        this_thread::sleep_for(backoff + chrono::milliseconds(5));
+        ASSERT_TRUE(breaker_->allow());
+        ASSERT_EQ(State::half_open, breaker_->state());
+    }
+
+    Config::Ptr config_;
+
+    CircuitBreaker::Ptr breaker_;
+};
+
+TEST_F(TestCircuitBreaker, opens_after_failures_in_a_row) {
+    EXPECT_EQ(State::closed, breaker_->state());
+    EXPECT_FALSE(breaker_->tripped());
+
+    // A success starts the count again
+    for (int i = 0; i < 2; ++i) {
+        ASSERT_TRUE(breaker_->allow());
+        breaker_->failure();
+    }
+    ASSERT_TRUE(breaker_->allow());
+    breaker_->success();
+    for (int i = 0; i < 2; ++i) {
+        ASSERT_TRUE(breaker_->allow());
+        breaker_->failure();
+    }
+    EXPECT_EQ(State::closed, breaker_->state());
+
+    ASSERT_TRUE(breaker_->allow());
+    breaker_->failure();
+    EXPECT_EQ(State::open, breaker_->state());
+    EXPECT_TRUE(breaker_->tripped());
+
+    // Requests fail fast now
+    EXPECT_FALSE(breaker_->allow());
+    EXPECT_FALSE(breaker_->allow());
+    EXPECT_EQ(2u, breaker_->rejected());
+}
+
+TEST_F(TestCircuitBreaker, late_failures_dont_extend_the_backoff) {
+    trip();
+
+    // Requests sent before we opened come back failed
+    breaker_->failure();
+    breaker_->failure();
+    probe(config_->breaker_backoff);
+}
+
+TEST_F(TestCircuitBreaker, lets_a_single_probe_through) {
+    trip();
+
+    // Never before half of the backoff
+    this_thread::sleep_for(config_->breaker_backoff / 4);
+    EXPECT_FALSE(breaker_->allow());
+
+    probe(config_->breaker_backoff);
+    EXPECT_FALSE(breaker_->allow());
+
+    // The API is back
+    breaker_->success();
+    EXPECT_EQ(State::closed, breaker_->state());
+    EXPECT_TRUE(breaker_->allow());
+}
+
+TEST_F(TestCircuitBreaker, failed_probe_backs_off_longer) {
+    trip();
+    probe(config_->breaker_backoff);
+    breaker_->failure();
+    EXPECT_EQ(State::open, breaker_->state());
+
+    // The backoff doubled: half of it is the whole previous one
+    this_thread::sleep_for(config_->breaker_backoff - chrono::milliseconds(5));
+    EXPECT_FALSE(breaker_->allow());
+    probe(config_->breaker_backoff * 2);
+
+    // And it doubles up to the maximum
+    breaker_->failure();
+    this_thread::sleep_for(config_->breaker_max_backoff / 2 -
+                           chrono::milliseconds(5));
+    EXPECT_FALSE(breaker_->allow());
+    probe(config_->breaker_max_backoff);
+
+    // Once closed, the next outage starts from the shortest backoff
+    breaker_->success();
+    trip();
+    probe(config_->breaker_backoff);
+}
+
+TEST_F(TestCircuitBreaker, abandoned_probe_makes_way_for_another) {
+    trip();
+    probe(config_->breaker_backoff);
+    EXPECT_FALSE(breaker_->allow());
+
+    // The probe was cancelled, it told nothing about the API
+    breaker_->abandon();
+    EXPECT_EQ(State::half_open, breaker_->state());
+    EXPECT_TRUE(breaker_->allow());
+    EXPECT_FALSE(breaker_->allow());
+}
+
+TEST_F(TestCircuitBreaker, abandoned_requests_dont_count) {
+    for (int i = 0; i < 5; ++i) {
+        ASSERT_TRUE(breaker_->allow());
+        breaker_->abandon();
+    }
+    EXPECT_EQ(State::closed, breaker_->state());
+}
+
+} // namespace
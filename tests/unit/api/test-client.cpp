@@ -0,0 +1,132 @@
+#include <api/client.h>
+
+#include <core/posix/exec.h>
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace std;
+using namespace api;
+
+namespace posix = core::posix;
+
+/**
+ * Keep the tests in an anonymous namespace
+ */
+namespace {
+
+typedef CircuitBreaker::State State;
+
+class TestClient: public ::testing::Test {
+protected:
+    void SetUp() override {
+        config_ = make_shared<Config>();
+        config_->breaker_failures = 2;
+        faults_ = "/tmp/discerning-duck-faults-" + to_string(getpid()) + ".json";
+    }
+
+    void TearDown() override {
+        if (pool_) {
+            pool_->stop();
+        }
+        remove(faults_.c_str());
+    }
+
+    /**
+     * Start up the fake DuckDuckGo server, misbehaving as told
+     */
+    void serve(const string &faults) {
+        ofstream(faults_) << faults;
+        fake_server_ = posix::exec("/usr/bin/python3",
+                                   { FAKE_SERVER, "--config", faults_ }, { },
+                                   posix::StandardStream::stdout);
+        ASSERT_GT(fake_server_.pid(), 0);
+
+        // The server will print out the random port it is using
+        string port;
+        fake_server_.cout() >> port;
+        ASSERT_FALSE(port.empty());
+
+        config_->apiroot = "http://127.0.0.1:" + port;
+        pool_ = make_shared<HttpPool>(config_);
+        breaker_ = make_shared<CircuitBreaker>(config_);
+    }
+
+    Config::Ptr config_;
+
+    HttpPool::Ptr pool_;
+
+    CircuitBreaker::Ptr breaker_;
+
+    string faults_;
+
+    /**
+     * Start by assuming the server is invalid
+     */
+    posix::ChildProcess fake_server_ = posix::ChildProcess::invalid();
+};
+
+TEST_F(TestClient, searches_out_of_time_leave_the_breaker_closed) {
+    // A healthy API, only slower than the budget of the searches
+    config_->query_deadline = chrono::milliseconds(50);
+    serve("{\"default\": {\"latency\": {\"distribution\": \"fixed\", \"ms\": 300}}}");
+
+    for (int i = 0; i < 5; ++i) {
+        Client client(config_, pool_, breaker_);
+        auto results = client.queryResults("python");
+        EXPECT_TRUE(results.degraded);
+        EXPECT_TRUE(results.isEmpty());
+    }
+    EXPECT_EQ(State::closed, breaker_->state());
+    EXPECT_EQ(0u, breaker_->rejected());
+}
+
+TEST_F(TestClient, server_errors_open_the_breaker) {
+    serve("{\"default\": {\"error_rate\": 1.0, \"error_status\": 503}}");
+
+    for (int i = 0; i < 2; ++i) {
+        Client client(config_, pool_, breaker_);
+        EXPECT_TRUE(client.queryResults("python").degraded);
+    }
+    EXPECT_EQ(State::open, breaker_->state());
+}
+
+/**
+ * The two forms of "big article" have different infoboxes: the ?q= one has
+ * the 12 facts of Ferrara, the path form 250 made up ones
+ */
+TEST_F(TestClient, path_form_is_not_shown_before_the_merge) {
+    serve("{\"query\": {\"latency\": {\"distribution\": \"fixed\", \"ms\": 300}}}");
+
+    // The path form arrives first, but the merge keeps the ?q= infobox
+    Client client(config_, pool_, breaker_);
+    vector<size_t> shown;
+    auto results = client.queryResults("big article",
+            [&shown](const Client::QueryResults &partial) {
+        shown.push_back(partial.infobox.size());
+    });
+    EXPECT_EQ(12u, results.infobox.size());
+    for (size_t size : shown) {
+        EXPECT_EQ(12u, size);
+    }
+}
+
+TEST_F(TestClient, query_form_is_shown_before_the_merge) {
+    serve("{\"path\": {\"latency\": {\"distribution\": \"fixed\", \"ms\": 300}}}");
+
+    Client client(config_, pool_, breaker_);
+    vector<size_t> shown;
+    auto results = client.queryResults("big article",
+            [&shown](const Client::QueryResults &partial) {
+        shown.push_back(partial.infobox.size());
+    });
+    EXPECT_EQ(12u, results.infobox.size());
+    EXPECT_EQ(vector<size_t>({ 12u }), shown);
+}
+
+} // namespace
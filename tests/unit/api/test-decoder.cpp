@@ -0,0 +1,251 @@
+#include <api/decoder.h>
+
+#include <gtest/gtest.h>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <QJsonDocument>
+#include <QVariantMap>
+
+using namespace std;
+using namespace api;
+
+/**
+ * Keep the tests in an anonymous namespace
+ */
+namespace {
+
+/**
+ * Load a recorded DuckDuckGo response
+ */
+string fixture(const string &name) {
+    ifstream file(string(DDG_FIXTURES) + "/" + name + ".json");
+    stringstream content;
+    content << file.rdbuf();
+    return content.str();
+}
+
+/**
+ * All the fields of the results, in a comparable form
+ */
+vector<string> fields(Client::QueryResults &results) {
+    vector<string> out;
+    results.for_each_text([&out](boost::string_ref &text) {
+        out.push_back(text.to_string());
+    });
+    for (const auto &content : results.infobox) {
+        out.push_back(to_string(content.wiki_order));
+    }
+    for (const auto &topic : results.relatedTopics) {
+        out.push_back(to_string(topic.icon.width) + "x" +
+                      to_string(topic.icon.height));
+    }
+    return out;
+}
+
+/**
+ * Decode a document both ways, which must agree
+ */
+bool decode(const string &document, Client::QueryResults &results) {
+    bool ok = Decoder::decode(document.data(), document.size(), results);
+
+    Client::QueryResults in_place;
+    string owned = document;
+    EXPECT_EQ(ok, Decoder::decode(move(owned), in_place)) << document;
+    EXPECT_EQ(fields(results), fields(in_place)) << document;
+    return ok;
+}
+
+/**
+ * The heading of a document which has only that, as a string
+ */
+string heading(const string &json) {
+    Client::QueryResults results;
+    EXPECT_TRUE(decode("{\"Heading\": \"" + json + "\"}", results)) << json;
+    return results.abstract.heading.to_string();
+}
+
+/**
+ * How the responses were decoded before the streaming decoder
+ */
+void qt_decode(const string &body, Client::QueryResults &results) {
+    QVariantMap variant = QJsonDocument::fromJson(body.c_str()).toVariant().toMap();
+    Arena &arena = results.arena;
+    auto text = [&arena](const QVariant &value) {
+        return arena.store(value.toString().toStdString());
+    };
+
+    results.abstract.summary = text(variant["Abstract"]);
+    results.abstract.textSummary = text(variant["AbstractText"]);
+    results.abstract.source = text(variant["AbstractSource"]);
+    results.abstract.url = text(variant["AbstractURL"]);
+    results.abstract.imageUrl = text(variant["Image"]);
+    results.abstract.heading = text(variant["Heading"]);
+    results.answer.instantAnswer = text(variant["Answer"]);
+    results.answer.type = text(variant["AnswerType"]);
+    results.definition.definition = text(variant["Definition"]);
+    results.definition.source = text(variant["DefinitionSource"]);
+    results.definition.url = text(variant["DefinitionURL"]);
+    results.type = text(variant["Type"]);
+
+    QVariantMap infobox = variant["Infobox"].toMap();
+    for (const QVariant &c : infobox["content"].toList()) {
+        QVariantMap item = c.toMap();
+        results.infobox.emplace_back(
+            Client::Content {
+                text(item["data_type"]),
+                text(item["value"]),
+                text(item["label"]),
+                item["wiki_order"].toUInt()
+            }
+        );
+    }
+
+    for (const QVariant &r : variant["RelatedTopics"].toList()) {
+        QVariantMap result = r.toMap();
+        QVariantMap icon = result["Icon"].toMap();
+        results.relatedTopics.emplace_back(
+            Client::Result {
+                text(result["Result"]),
+                text(result["FirstURL"]),
+                Client::Icon {
+                    text(icon["URL"]),
+                    icon["Width"].toUInt(),
+                    icon["Height"].toUInt()
+                },
+                text(result["Text"])
+            }
+        );
+    }
+}
+
+class TestDecoderFixture: public ::testing::TestWithParam<string> {
+};
+
+TEST_P(TestDecoderFixture, same_as_qjsondocument) {
+    string body = fixture(GetParam());
+    ASSERT_FALSE(body.empty());
+
+    Client::QueryResults ours, theirs;
+    ASSERT_TRUE(decode(body, ours));
+    qt_decode(body, theirs);
+    EXPECT_EQ(fields(theirs), fields(ours));
+}
+
+INSTANTIATE_TEST_CASE_P(Responses, TestDecoderFixture, ::testing::Values(
+        "answer", "article", "category", "disambiguation", "empty",
+        "large-disambiguation", "large-infobox"));
+
+TEST(Decoder, escapes) {
+    EXPECT_EQ("a\"b\\c/d\b\f\n\r\te", heading("a\\\"b\\\\c\\/d\\b\\f\\n\\r\\te"));
+    EXPECT_EQ("caf\xC3\xA9 \xE2\x82\xAC", heading("caf\\u00e9 \\u20AC"));
+    EXPECT_EQ(string("a\0b", 3), heading("a\\u0000b"));
+}
+
+TEST(Decoder, surrogate_pairs) {
+    // U+1F986, a duck
+    EXPECT_EQ("\xF0\x9F\xA6\x86", heading("\\ud83e\\udd86"));
+    EXPECT_EQ("x\xF0\x9F\xA6\x86y", heading("x\\uD83E\\uDD86y"));
+}
+
+TEST(Decoder, lone_surrogates) {
+    const string replacement = "\xEF\xBF\xBD";
+    EXPECT_EQ(replacement, heading("\\ud83e"));
+    EXPECT_EQ(replacement + "x", heading("\\ud83ex"));
+    EXPECT_EQ(replacement + "x", heading("\\udd86x"));
+    EXPECT_EQ(replacement + "\\n", heading("\\ud83e\\\\n"));
+
+    // An escape which doesn't complete the pair is decoded on its own
+    EXPECT_EQ(replacement + "\xC3\xA9", heading("\\ud83e\\u00e9"));
+    EXPECT_EQ(replacement + "\xF0\x9F\xA6\x86", heading("\\ud83e\\ud83e\\udd86"));
+    EXPECT_EQ(replacement + replacement, heading("\\ud83e\\ud83e"));
+}
+
+TEST(Decoder, skips_what_we_dont_use) {
+    Client::QueryResults results;
+    ASSERT_TRUE(decode(
+        "{\"meta\": {\"a\": [1, -2.5e3, {\"b\": \"}]\\\"\", \"c\": [[], {}]}],"
+        " \"d\": null, \"e\": true, \"f\": false},"
+        " \"Heading\": \"Ferrara\","
+        " \"Infobox\": \"\","
+        " \"RelatedTopics\": [{\"Name\": \"Places\", \"Topics\": [{\"Text\": \"x\"}]},"
+        "   {\"Text\": \"Ferrara Cathedral\", \"FirstURL\": \"https://duckduckgo.com/Ferrara_Cathedral\","
+        "    \"Icon\": {\"URL\": \"\", \"Width\": \"\", \"Height\": 16}}],"
+        " \"ImageIsLogo\": 0}", results));
+
+    EXPECT_EQ("Ferrara", results.abstract.heading);
+    EXPECT_TRUE(results.infobox.empty());
+    ASSERT_EQ(2u, results.relatedTopics.size());
+
+    // A group of topics has nothing we read
+    EXPECT_TRUE(results.relatedTopics[0].text.empty());
+    EXPECT_EQ("Ferrara Cathedral", results.relatedTopics[1].text);
+    EXPECT_EQ(0u, results.relatedTopics[1].icon.width);
+    EXPECT_EQ(16u, results.relatedTopics[1].icon.height);
+}
+
+TEST(Decoder, numbers) {
+    Client::QueryResults results;
+    ASSERT_TRUE(decode(
+        "{\"Infobox\": {\"content\": [{\"wiki_order\": 3}, {\"wiki_order\": \"4\"},"
+        " {\"wiki_order\": 5.0}, {\"wiki_order\": \"five\"}, {\"wiki_order\": null}],"
+        " \"meta\": []}, \"Answer\": 42}", results));
+
+    ASSERT_EQ(5u, results.infobox.size());
+    EXPECT_EQ(3u, results.infobox[0].wiki_order);
+    EXPECT_EQ(4u, results.infobox[1].wiki_order);
+    EXPECT_EQ(5u, results.infobox[2].wiki_order);
+    EXPECT_EQ(0u, results.infobox[3].wiki_order);
+    EXPECT_EQ(0u, results.infobox[4].wiki_order);
+
+    // Numbers read as text keep their text
+    EXPECT_EQ("42", results.answer.instantAnswer);
+}
+
+TEST(Decoder, truncated) {
+    string body = fixture("article");
+    while (!body.empty() && isspace(static_cast<unsigned char>(body.back()))) {
+        body.pop_back();
+    }
+    ASSERT_FALSE(body.empty());
+
+    // No prefix of a document is a document, and nothing of it is kept
+    for (size_t size = 0; size < body.size(); ++size) {
+        Client::QueryResults results;
+        ASSERT_FALSE(decode(body.substr(0, size), results)) << size;
+        ASSERT_TRUE(results.isEmpty()) << size;
+        ASSERT_TRUE(results.abstract.summary.empty()) << size;
+    }
+}
+
+TEST(Decoder, malformed) {
+    for (const string &document : {
+            "",
+            "[]",
+            "\"Heading\"",
+            "{\"Heading\": \"x\",}",
+            "{\"Heading\" \"x\"}",
+            "{\"Heading\": \"x\"} {}",
+            "{\"Heading\": \"x\" \"Type\": \"A\"}",
+            "{\"Heading\": tru}",
+            "{\"Heading\": nul}",
+            "{\"Heading\": \"\\x\"}",
+            "{\"Heading\": \"\\u12\"}",
+            "{\"Heading\": \"\\u12g4\"}",
+            "{\"Heading\": \"\\ud83e\\u12\"}",
+            "{\"Heading\": \"x\\\"}",
+            "{\"Heading\": [1, 2}",
+            "{\"Heading\": {\"a\": 1]}",
+            "{\"Type\": \"A\", \"Heading\": }",
+            }) {
+        Client::QueryResults results;
+        EXPECT_FALSE(decode(document, results)) << document;
+        EXPECT_TRUE(results.isEmpty()) << document;
+        EXPECT_TRUE(results.type.empty()) << document;
+    }
+}
+
+} // namespace
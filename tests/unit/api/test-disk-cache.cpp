@@ -0,0 +1,242 @@
+#include <api/disk_cache.h>
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace api;
+
+/**
+ * Keep the tests in an anonymous namespace
+ */
+namespace {
+
+/**
+ * All the queries share the same hash
+ */
+class CollidingDiskCache: public DiskCache {
+public:
+    using DiskCache::DiskCache;
+
+    ~CollidingDiskCache() {
+        // The compactor hashes too, stop it while we are still whole
+        stop();
+    }
+
+protected:
+    uint64_t hash(const string &) const override {
+        return 42;
+    }
+};
+
+class TestDiskCache: public ::testing::Test {
+protected:
+    void SetUp() override {
+        config_ = make_shared<Config>();
+        path_ = "/tmp/discerning-duck-test-" + to_string(getpid()) + ".log";
+        remove(path_.c_str());
+    }
+
+    void TearDown() override {
+        remove(path_.c_str());
+        remove((path_ + ".tmp").c_str());
+    }
+
+    DiskCache::Ptr cache() {
+        return make_shared<DiskCache>(config_, path_);
+    }
+
+    /**
+     * Results with a heading, and a summary of the given size
+     */
+    static Client::QueryResults results(const string &heading,
+                                        size_t size = 0) {
+        Client::QueryResults results;
+        results.abstract.heading = results.arena.store(heading);
+        results.abstract.summary = results.arena.store(string(size, 'x'));
+        results.type = results.arena.store(string("A"));
+
+        string label = heading + " label";
+        results.infobox.emplace_back(Client::Content {
+            results.arena.store(string("string")),
+            results.arena.store(heading),
+            results.arena.store(label), 3 });
+        return results;
+    }
+
+    uint64_t file_size() {
+        struct stat st;
+        return stat(path_.c_str(), &st) == 0 ? st.st_size : 0;
+    }
+
+    /**
+     * Wait up to a second for a condition
+     */
+    template<typename F>
+    bool eventually(F f) {
+        for (int i = 0; i < 200 && !f(); ++i) {
+            this_thread::sleep_for(chrono::milliseconds(5));
+        }
+        return f();
+    }
+
+    Config::Ptr config_;
+
+    string path_;
+};
+
+TEST_F(TestDiskCache, append) {
+    auto disk = cache();
+    EXPECT_FALSE(disk->get("python"));
+
+    disk->put("python", results("Python"));
+    disk->put("ferrara", results("Ferrara"));
+    disk->put("python", results("Python 3"));
+
+    auto python = disk->get("python");
+    ASSERT_TRUE(bool(python));
+    EXPECT_EQ("Python 3", python->abstract.heading);
+    EXPECT_EQ("A", python->type);
+    ASSERT_EQ(1u, python->infobox.size());
+    EXPECT_EQ("Python 3 label", python->infobox[0].label);
+    EXPECT_EQ(3u, python->infobox[0].wiki_order);
+
+    auto ferrara = disk->get("ferrara");
+    ASSERT_TRUE(bool(ferrara));
+    EXPECT_EQ("Ferrara", ferrara->abstract.heading);
+}
+
+TEST_F(TestDiskCache, reopen) {
+    cache()->put("python", results("Python"));
+    cache()->put("ferrara", results("Ferrara"));
+
+    auto disk = cache();
+    auto python = disk->get("python");
+    ASSERT_TRUE(bool(python));
+    EXPECT_EQ("Python", python->abstract.heading);
+    ASSERT_TRUE(bool(disk->get("ferrara")));
+}
+
+TEST_F(TestDiskCache, expired_results_are_only_stale) {
+    config_->disk_cache_ttl = chrono::seconds(-1);
+    auto disk = cache();
+    disk->put("python", results("Python"));
+
+    EXPECT_FALSE(disk->get("python"));
+    ASSERT_TRUE(bool(disk->get("python", true)));
+}
+
+TEST_F(TestDiskCache, file_grows_ahead_of_the_log) {
+    auto disk = cache();
+    disk->put("python", results("Python"));
+    uint64_t reserved = file_size();
+    EXPECT_LT(disk->size(), reserved);
+
+    // The next appends go in the room left
+    disk->put("ferrara", results("Ferrara"));
+    disk->put("italy", results("Italy"));
+    EXPECT_EQ(reserved, file_size());
+
+    // Until there is no more, then it doubles
+    disk->put("big article", results("Big article", reserved));
+    EXPECT_GE(file_size(), 2 * reserved);
+    EXPECT_EQ("Python", disk->get("python")->abstract.heading);
+    EXPECT_EQ("Big article", disk->get("big article")->abstract.heading);
+
+    // The room isn't mistaken for records
+    auto again = cache();
+    EXPECT_EQ("Italy", again->get("italy")->abstract.heading);
+    EXPECT_EQ(disk->size(), again->size());
+}
+
+TEST_F(TestDiskCache, torn_record_is_dropped) {
+    uint64_t size;
+    {
+        auto disk = cache();
+        disk->put("python", results("Python"));
+        disk->put("ferrara", results("Ferrara"));
+        size = disk->size();
+    }
+
+    // A crash in the middle of an append leaves part of a record
+    {
+        fstream log(path_, ios::binary | ios::in | ios::out);
+        log.seekp(size);
+        log << "DDC2\x06";
+    }
+    ASSERT_GT(file_size(), size);
+
+    auto disk = cache();
+    ASSERT_TRUE(bool(disk->get("python")));
+    ASSERT_TRUE(bool(disk->get("ferrara")));
+    EXPECT_EQ(size, disk->size());
+    EXPECT_EQ(size, file_size());
+
+    // And the next records are appended after the good ones
+    disk->put("italy", results("Italy"));
+    ASSERT_TRUE(bool(cache()->get("italy")));
+}
+
+TEST_F(TestDiskCache, compaction_drops_dead_records) {
+    auto disk = cache();
+    for (int i = 0; i < 20; ++i) {
+        disk->put("python", results("Python " + to_string(i), 8 * 1024));
+    }
+    disk->put("ferrara", results("Ferrara"));
+
+    // The log is compacted in background, down to the latest records: only
+    // the ones appended since the last compaction may be left
+    EXPECT_TRUE(eventually([&disk]() {
+        return disk->size() < 10 * 8 * 1024;
+    }));
+    auto python = disk->get("python");
+    ASSERT_TRUE(bool(python));
+    EXPECT_EQ("Python 19", python->abstract.heading);
+    ASSERT_TRUE(bool(disk->get("ferrara")));
+
+    // Appends go on after the compacted log
+    disk->put("italy", results("Italy"));
+    ASSERT_TRUE(bool(cache()->get("italy")));
+    EXPECT_EQ("Python 19", cache()->get("python")->abstract.heading);
+}
+
+TEST_F(TestDiskCache, compaction_keeps_the_newest_within_the_size) {
+    config_->disk_cache_size = 100 * 1024;
+    auto disk = cache();
+    for (int i = 0; i < 20; ++i) {
+        disk->put("query " + to_string(i), results("Query", 8 * 1024));
+    }
+
+    EXPECT_TRUE(eventually([this, &disk]() {
+        return disk->size() <= config_->disk_cache_size;
+    }));
+    EXPECT_FALSE(disk->get("query 0"));
+    EXPECT_TRUE(bool(disk->get("query 19")));
+}
+
+TEST_F(TestDiskCache, colliding_queries_keep_their_results) {
+    {
+        CollidingDiskCache disk(config_, path_);
+        disk.put("python", results("Python"));
+        disk.put("ferrara", results("Ferrara"));
+
+        EXPECT_FALSE(disk.get("ferrara"));
+        auto python = disk.get("python");
+        ASSERT_TRUE(bool(python));
+        EXPECT_EQ("Python", python->abstract.heading);
+    }
+
+    // Not even after reading the log again
+    CollidingDiskCache disk(config_, path_);
+    EXPECT_FALSE(disk.get("ferrara"));
+    ASSERT_TRUE(bool(disk.get("python")));
+}
+
+} // namespace
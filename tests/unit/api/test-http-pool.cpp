@@ -0,0 +1,113 @@
+#include <api/http_pool.h>
+
+#include <core/net/error.h>
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+
+using namespace std;
+using namespace api;
+
+namespace net = core::net;
+
+/**
+ * Keep the tests in an anonymous namespace
+ */
+namespace {
+
+/**
+ * Hands out the connections without sending anything through them
+ */
+class SlotPool: public HttpPool {
+public:
+    using HttpPool::HttpPool;
+    using HttpPool::acquire;
+    using HttpPool::release;
+};
+
+typedef chrono::steady_clock Clock;
+
+class TestHttpPool: public ::testing::Test {
+protected:
+    void SetUp() override {
+        config_ = make_shared<Config>();
+        config_->max_connections_per_host = 1;
+        pool_ = make_shared<SlotPool>(config_);
+    }
+
+    const Clock::time_point never = Clock::time_point::max();
+
+    Config::Ptr config_;
+
+    shared_ptr<SlotPool> pool_;
+};
+
+TEST_F(TestHttpPool, waits_for_a_connection_until_the_deadline) {
+    pool_->acquire("http://a", never, nullptr);
+    EXPECT_EQ(0u, pool_->waited());
+
+    auto started = Clock::now();
+    EXPECT_THROW(pool_->acquire("http://a", started + chrono::milliseconds(50),
+                                nullptr), net::Error);
+    EXPECT_GE(Clock::now() - started, chrono::milliseconds(50));
+    EXPECT_LT(Clock::now() - started, chrono::seconds(1));
+    EXPECT_EQ(1u, pool_->waited());
+
+    // The connection is still there for the next request
+    pool_->release("http://a");
+    pool_->acquire("http://a", started + chrono::milliseconds(50), nullptr);
+}
+
+TEST_F(TestHttpPool, cancelled_request_stops_waiting) {
+    pool_->acquire("http://a", never, nullptr);
+
+    atomic<bool> cancelled(false);
+    auto waiting = async(launch::async, [this, &cancelled]() {
+        pool_->acquire("http://a", never, &cancelled);
+    });
+    EXPECT_EQ(future_status::timeout,
+              waiting.wait_for(chrono::milliseconds(50)));
+
+    cancelled = true;
+    pool_->wake();
+    ASSERT_EQ(future_status::ready, waiting.wait_for(chrono::seconds(1)));
+    EXPECT_THROW(waiting.get(), net::Error);
+}
+
+TEST_F(TestHttpPool, released_connection_goes_to_its_host) {
+    pool_->acquire("http://a", never, nullptr);
+    pool_->acquire("http://b", never, nullptr);
+
+    auto waiting = async(launch::async, [this]() {
+        pool_->acquire("http://a", never, nullptr);
+    });
+    EXPECT_EQ(future_status::timeout,
+              waiting.wait_for(chrono::milliseconds(20)));
+
+    // Another host has room now, not ours
+    pool_->release("http://b");
+    EXPECT_EQ(future_status::timeout,
+              waiting.wait_for(chrono::milliseconds(20)));
+
+    pool_->release("http://a");
+    ASSERT_EQ(future_status::ready, waiting.wait_for(chrono::seconds(1)));
+    waiting.get();
+}
+
+TEST_F(TestHttpPool, stop_wakes_up_the_waiting_requests) {
+    pool_->acquire("http://a", never, nullptr);
+
+    auto waiting = async(launch::async, [this]() {
+        pool_->acquire("http://a", never, nullptr);
+    });
+    EXPECT_EQ(future_status::timeout,
+              waiting.wait_for(chrono::milliseconds(20)));
+
+    pool_->stop();
+    ASSERT_EQ(future_status::ready, waiting.wait_for(chrono::seconds(1)));
+    EXPECT_THROW(waiting.get(), net::Error);
+}
+
+} // namespace
@@ -0,0 +1,205 @@
+#include <api/ingest.h>
+
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+
+using namespace std;
+using namespace api;
+
+/**
+ * Keep the tests in an anonymous namespace
+ */
+namespace {
+
+/**
+ * Clean a text, returned as a string
+ */
+string clean(const string &text) {
+    Arena arena;
+    return Ingest::clean(text, arena).to_string();
+}
+
+/**
+ * Whether a text is valid UTF-8, checked one code point at a time
+ */
+bool valid_utf8(const string &text) {
+    for (size_t i = 0; i < text.size();) {
+        unsigned char c = text[i];
+        size_t size;
+        unsigned int cp;
+        if (c < 0x80) {
+            size = 1;
+            cp = c;
+        } else if ((c & 0xE0) == 0xC0) {
+            size = 2;
+            cp = c & 0x1F;
+        } else if ((c & 0xF0) == 0xE0) {
+            size = 3;
+            cp = c & 0x0F;
+        } else if ((c & 0xF8) == 0xF0) {
+            size = 4;
+            cp = c & 0x07;
+        } else {
+            return false;
+        }
+        if (text.size() - i < size) {
+            return false;
+        }
+        for (size_t k = 1; k < size; ++k) {
+            unsigned char next = text[i + k];
+            if ((next & 0xC0) != 0x80) {
+                return false;
+            }
+            cp = cp << 6 | (next & 0x3F);
+        }
+        static const unsigned int SMALLEST[] = { 0, 0, 0x80, 0x800, 0x10000 };
+        if (cp < SMALLEST[size] || cp > 0x10FFFF ||
+                (cp >= 0xD800 && cp <= 0xDFFF)) {
+            return false;
+        }
+        i += size;
+    }
+    return true;
+}
+
+TEST(Ingest, clean_text_is_untouched) {
+    Arena arena;
+    string text = "Ferrara is a city in Emilia-Romagna, Italy. Caff\xc3\xa8 \xe2\x82\xac 5 "
+            "\xf0\x9f\xa6\x86 & co.";
+    boost::string_ref cleaned = Ingest::clean(text, arena);
+    EXPECT_EQ(text.data(), cleaned.data());
+    EXPECT_EQ(text.size(), cleaned.size());
+    EXPECT_EQ(0, arena.size());
+}
+
+TEST(Ingest, named_entities) {
+    EXPECT_EQ("Tom & Jerry", clean("Tom &amp; Jerry"));
+    EXPECT_EQ("<b>\"x\" 'y'</b>", clean("&lt;b&gt;&quot;x&quot; &apos;y&apos;&lt;/b&gt;"));
+    EXPECT_EQ("1\xc2\xa0km", clean("1&nbsp;km"));
+    EXPECT_EQ("1990\xe2\x80\x93" "2000\xe2\x80\xa6", clean("1990&ndash;2000&hellip;"));
+}
+
+TEST(Ingest, numeric_entities) {
+    EXPECT_EQ("it's", clean("it&#39;s"));
+    EXPECT_EQ("\xc3\xa9t\xc3\xa9", clean("&#xE9;t&#233;"));
+    EXPECT_EQ("\xf0\x9f\xa6\x86", clean("&#x1F986;"));
+    // Nothing which could be shown
+    EXPECT_EQ("\xef\xbf\xbd", clean("&#0;"));
+    EXPECT_EQ("\xef\xbf\xbd", clean("&#xD800;"));
+    EXPECT_EQ("\xef\xbf\xbd", clean("&#x110000;"));
+}
+
+TEST(Ingest, not_entities) {
+    EXPECT_EQ("AT&T", clean("AT&T"));
+    EXPECT_EQ("a & b; c", clean("a & b; c"));
+    EXPECT_EQ("&unknown;", clean("&unknown;"));
+    EXPECT_EQ("&#;&#x;&#12a;", clean("&#;&#x;&#12a;"));
+    EXPECT_EQ("&amp", clean("&amp"));
+    EXPECT_EQ("&", clean("&"));
+    EXPECT_EQ("&&amp", clean("&&amp;amp"));
+}
+
+TEST(Ingest, invalid_utf8) {
+    // Stray continuation, overlong forms, surrogates, past U+10FFFF
+    EXPECT_EQ("a\xef\xbf\xbd" "b", clean("a\x80" "b"));
+    EXPECT_EQ("\xef\xbf\xbd\xef\xbf\xbd", clean("\xc0\xaf"));
+    EXPECT_EQ("\xef\xbf\xbd\xef\xbf\xbd\xef\xbf\xbd", clean("\xe0\x80\xaf"));
+    EXPECT_EQ("\xef\xbf\xbd\xef\xbf\xbd\xef\xbf\xbd", clean("\xed\xa0\x80"));
+    EXPECT_EQ("\xef\xbf\xbd\xef\xbf\xbd\xef\xbf\xbd\xef\xbf\xbd",
+              clean("\xf4\x90\x80\x80"));
+    // Truncated sequences
+    EXPECT_EQ("caff\xef\xbf\xbd", clean("caff\xc3"));
+    EXPECT_EQ("\xef\xbf\xbd\xef\xbf\xbd" "x", clean("\xe2\x82" "x"));
+}
+
+/**
+ * The vectorized scan sees 16 bytes at a time: put what needs cleaning at
+ * every position of a longer text
+ */
+TEST(Ingest, every_position) {
+    for (size_t size = 1; size < 50; ++size) {
+        for (size_t at = 0; at < size; ++at) {
+            string text(size, 'x');
+            EXPECT_EQ(size, Ingest::plain(text));
+
+            text[at] = '&';
+            EXPECT_EQ(at, Ingest::plain(text));
+            text[at] = '\xc3';
+            EXPECT_EQ(at, Ingest::plain(text));
+
+            string expected(size, 'x');
+            expected.replace(at, 1, "\xef\xbf\xbd");
+            EXPECT_EQ(expected, clean(text));
+
+            expected.replace(at, 3, "&");
+            EXPECT_EQ(expected, clean(string(text).replace(at, 1, "&amp;")));
+        }
+    }
+}
+
+TEST(Ingest, validate_keeps_the_entities) {
+    Arena arena;
+    EXPECT_EQ("a&amp;b=\xef\xbf\xbd", Ingest::validate("a&amp;b=\xff", arena));
+
+    string url = "https://duckduckgo.com/?q=AT&amp;T";
+    boost::string_ref validated = Ingest::validate(url, arena);
+    EXPECT_EQ(url.data(), validated.data());
+}
+
+TEST(Ingest, results) {
+    Client::QueryResults results;
+    string heading = "Tom &amp; Jerry";
+    string text = "A \xff cartoon &amp; more";
+    string html = "<a href=\"https://duckduckgo.com/Tom_&amp;_Jerry\">Tom &amp; Jerry</a>\xff";
+    string url = "https://duckduckgo.com/?q=a&amp;b";
+    results.abstract.heading = heading;
+    results.abstract.url = url;
+    results.results.emplace_back(Client::Result { html, url, Client::Icon { url, 0, 0 }, text });
+
+    Ingest::clean(results);
+    EXPECT_EQ("Tom & Jerry", results.abstract.heading);
+    EXPECT_EQ("A \xef\xbf\xbd cartoon & more", results.results[0].text);
+
+    // URLs and markup are only validated
+    EXPECT_EQ(url, results.abstract.url);
+    EXPECT_EQ(url, results.results[0].url);
+    EXPECT_EQ(url, results.results[0].icon.url);
+    EXPECT_EQ("<a href=\"https://duckduckgo.com/Tom_&amp;_Jerry\">Tom &amp; Jerry</a>"
+              "\xef\xbf\xbd", results.results[0].result);
+}
+
+TEST(Ingest, fuzz) {
+    static const string PIECES[] = {
+        "&amp;", "&#233;", "&#x1F986;", "&", ";", "#", "x", "\xc3\xa9", "\xc3",
+        "\xa9", "\xe2\x82\xac", "\xed\xa0\x80", "\xf0\x9f\xa6\x86", "\xf0\x9f",
+        "\xff", string(1, '\0'), string(17, 'y')
+    };
+    const size_t count = sizeof(PIECES) / sizeof(PIECES[0]);
+
+    mt19937 random(42);
+    for (int i = 0; i < 20000; ++i) {
+        string text;
+        size_t pieces = random() % 12;
+        for (size_t k = 0; k < pieces; ++k) {
+            text += PIECES[random() % count];
+        }
+
+        string cleaned = clean(text);
+        ASSERT_TRUE(valid_utf8(cleaned)) << text;
+
+        // Validating only replaces the invalid bytes
+        Arena arena;
+        string validated = Ingest::validate(text, arena).to_string();
+        ASSERT_TRUE(valid_utf8(validated)) << text;
+        if (valid_utf8(text)) {
+            ASSERT_EQ(text, validated);
+        }
+        // Text already valid and without entities is kept as it is
+        if (valid_utf8(text) && text.find('&') == string::npos) {
+            ASSERT_EQ(text, cleaned);
+        }
+    }
+}
+
+} // namespace
@@ -0,0 +1,153 @@
+#include <api/markup.h>
+
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+
+using namespace std;
+using namespace api;
+
+/**
+ * Keep the tests in an anonymous namespace
+ */
+namespace {
+
+/**
+ * Whether a piece is a view into the snippet, or empty
+ */
+bool within(boost::string_ref piece, const string &html) {
+    return piece.empty() || (piece.data() >= html.data() &&
+            piece.data() + piece.size() <= html.data() + html.size());
+}
+
+/**
+ * Random snippets, mostly made of the characters of the markup, so they are
+ * malformed in many ways
+ */
+string random_snippet(mt19937 &random) {
+    static const string PIECES[] = {
+        "<a href=\"x\">", "<a", "</a>", "</a", "<", ">", "\"", "/", "a", " - ",
+        "@</span>", "</div>", "<span class='suninfo--risebox'>", "x", "\xc3\xa9",
+        string(1, '\0'), string(17, 'y')
+    };
+    const size_t count = sizeof(PIECES) / sizeof(PIECES[0]);
+
+    string snippet;
+    size_t pieces = random() % 12;
+    for (size_t i = 0; i < pieces; ++i) {
+        snippet += PIECES[random() % count];
+    }
+    return snippet;
+}
+
+TEST(Markup, anchor) {
+    string html = "<a href=\"https://duckduckgo.com/Ferrara\">Ferrara</a> - A city in Italy";
+    Markup::Anchor anchor = Markup::anchor(html);
+    EXPECT_EQ("Ferrara", anchor.title);
+    EXPECT_EQ(" - A city in Italy", anchor.text);
+}
+
+TEST(Markup, anchor_without_text) {
+    Markup::Anchor anchor = Markup::anchor("<a href=\"x\">Python</a>");
+    EXPECT_EQ("Python", anchor.title);
+    EXPECT_TRUE(anchor.text.empty());
+}
+
+TEST(Markup, anchor_without_closing_tag) {
+    Markup::Anchor anchor = Markup::anchor("<a href=\"x\">Python, the snake");
+    EXPECT_EQ("Python, the snake", anchor.title);
+    EXPECT_TRUE(anchor.text.empty());
+}
+
+TEST(Markup, anchor_without_link) {
+    Markup::Anchor anchor = Markup::anchor("Just some text</a> here");
+    EXPECT_TRUE(anchor.title.empty());
+    EXPECT_EQ("Just some text</a> here", anchor.text);
+
+    anchor = Markup::anchor("<a href=\"never closed");
+    EXPECT_TRUE(anchor.title.empty());
+    EXPECT_EQ("<a href=\"never closed", anchor.text);
+
+    anchor = Markup::anchor("");
+    EXPECT_TRUE(anchor.title.empty());
+    EXPECT_TRUE(anchor.text.empty());
+}
+
+TEST(Markup, sunrise) {
+    Markup::Sunrise sunrise = Markup::sunrise(
+            "<div class='suninfo__location'><span>Sunrise and sunset @</span>"
+            "Ferrara, Italy</div><span class='suninfo--risebox'>7:21 AM</span>");
+    EXPECT_EQ("Ferrara, Italy", sunrise.location);
+    EXPECT_EQ("<span class='suninfo--risebox'>7:21 AM</span>", sunrise.times);
+}
+
+TEST(Markup, sunrise_malformed) {
+    Markup::Sunrise sunrise = Markup::sunrise("Sunrise @ somewhere");
+    EXPECT_TRUE(sunrise.location.empty());
+    EXPECT_TRUE(sunrise.times.empty());
+
+    sunrise = Markup::sunrise("@</span>Ferrara, Italy");
+    EXPECT_TRUE(sunrise.location.empty());
+    EXPECT_TRUE(sunrise.times.empty());
+}
+
+/**
+ * The vectorized scans see 16 bytes at a time: put the target at every
+ * position of a longer text, and start from every offset
+ */
+TEST(Markup, find_at_every_position) {
+    for (size_t size = 0; size < 70; ++size) {
+        for (size_t at = 0; at < size; ++at) {
+            string text(size, 'x');
+            text[at] = '<';
+            if (at + 3 < size) {
+                text.replace(at, 4, "</a>");
+            }
+            for (size_t from = 0; from <= size + 1; ++from) {
+                EXPECT_EQ(text.find('<', from), Markup::find(text, '<', from));
+                EXPECT_EQ(text.find("</a>", from), Markup::find(text, "</a>", from));
+            }
+        }
+    }
+}
+
+TEST(Markup, find_fuzz) {
+    mt19937 random(42);
+    for (int i = 0; i < 20000; ++i) {
+        string text = random_snippet(random);
+        string needle = random_snippet(random).substr(0, random() % 6);
+        size_t from = random() % (text.size() + 2);
+
+        ASSERT_EQ(text.find(needle, from) == string::npos ?
+                      Markup::npos : text.find(needle, from),
+                  Markup::find(text, needle, from))
+                << "text: " << text << " needle: " << needle << " from: " << from;
+        if (!needle.empty()) {
+            ASSERT_EQ(text.find(needle[0], from) == string::npos ?
+                          Markup::npos : text.find(needle[0], from),
+                      Markup::find(text, needle[0], from));
+        }
+    }
+}
+
+TEST(Markup, anchor_fuzz) {
+    mt19937 random(42);
+    for (int i = 0; i < 20000; ++i) {
+        string html = random_snippet(random);
+        Markup::Anchor anchor = Markup::anchor(html);
+
+        ASSERT_TRUE(within(anchor.title, html)) << html;
+        ASSERT_TRUE(within(anchor.text, html)) << html;
+        ASSERT_LE(anchor.title.size() + anchor.text.size(), html.size()) << html;
+        // Nothing but the tags is lost
+        if (anchor.title.empty()) {
+            ASSERT_TRUE(anchor.text == html || html.compare(0, 2, "<a") == 0) << html;
+        }
+
+        Markup::Sunrise sunrise = Markup::sunrise(html);
+        ASSERT_TRUE(within(sunrise.location, html)) << html;
+        ASSERT_TRUE(within(sunrise.times, html)) << html;
+    }
+}
+
+} // namespace
@@ -0,0 +1,67 @@
+#include <api/result_cache.h>
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
+
+using namespace std;
+using namespace api;
+
+/**
+ * Keep the tests in an anonymous namespace
+ */
+namespace {
+
+class TestResultCache: public ::testing::Test {
+protected:
+    void SetUp() override {
+        config_ = make_shared<Config>();
+        config_->cache_size = 2;
+        cache_ = make_shared<ResultCache>(config_);
+    }
+
+    static ResultCache::Entry entry() {
+        return make_shared<const Client::QueryResults>();
+    }
+
+    Config::Ptr config_;
+
+    ResultCache::Ptr cache_;
+};
+
+TEST_F(TestResultCache, evicts_the_least_recently_used) {
+    auto python = entry(), ferrara = entry(), italy = entry();
+    cache_->put("python", python);
+    cache_->put("ferrara", ferrara);
+    EXPECT_EQ(python, cache_->get("python"));
+
+    cache_->put("italy", italy);
+    EXPECT_EQ(2u, cache_->size());
+    EXPECT_EQ(python, cache_->get("python"));
+    EXPECT_EQ(italy, cache_->get("italy"));
+    EXPECT_FALSE(cache_->get("ferrara"));
+}
+
+TEST_F(TestResultCache, expired_results_are_only_stale) {
+    config_->cache_ttl = chrono::seconds(0);
+    config_->cache_stale_ttl = chrono::seconds(60);
+    auto python = entry();
+    cache_->put("python", python);
+    this_thread::sleep_for(chrono::milliseconds(5));
+
+    EXPECT_FALSE(cache_->get("python"));
+    EXPECT_EQ(python, cache_->get("python", true));
+    EXPECT_EQ(1u, cache_->size());
+}
+
+TEST_F(TestResultCache, stale_results_are_dropped_in_time) {
+    config_->cache_ttl = chrono::seconds(0);
+    config_->cache_stale_ttl = chrono::seconds(0);
+    cache_->put("python", entry());
+    this_thread::sleep_for(chrono::milliseconds(5));
+
+    EXPECT_FALSE(cache_->get("python", true));
+    EXPECT_EQ(0u, cache_->size());
+}
+
+} // namespace
@@ -0,0 +1,153 @@
+#include <api/single_flight.h>
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using namespace std;
+using namespace api;
+
+/**
+ * Keep the tests in an anonymous namespace
+ */
+namespace {
+
+/**
+ * A fetch which takes a while, unless its flight is aborted
+ */
+SingleFlight::Fetch slow_fetch(atomic<int> &fetches, atomic<int> &aborted) {
+    return [&fetches, &aborted](Client &client, const Client::Partial &) {
+        ++fetches;
+        for (int i = 0; i < 100 && !client.cancelled(); ++i) {
+            this_thread::sleep_for(chrono::milliseconds(5));
+        }
+        auto results = make_shared<Client::QueryResults>();
+        if (client.cancelled()) {
+            ++aborted;
+        } else {
+            results->answer.type = "calc";
+        }
+        return SingleFlight::Results(results);
+    };
+}
+
+class TestSingleFlight: public ::testing::Test {
+protected:
+    void SetUp() override {
+        flights_ = make_shared<SingleFlight>(make_shared<Config>(),
+                                             HttpPool::Ptr());
+    }
+
+    SingleFlight::Ptr flights_;
+
+    atomic<int> fetches_ { 0 };
+
+    atomic<int> aborted_ { 0 };
+};
+
+TEST(SingleFlight, normalize) {
+    EXPECT_EQ("python", SingleFlight::normalize("Python"));
+    EXPECT_EQ("3 * 2", SingleFlight::normalize("  3   *\t2 "));
+    EXPECT_EQ("", SingleFlight::normalize(" \n "));
+}
+
+TEST_F(TestSingleFlight, identical_queries_share_the_fetch) {
+    auto fetch = slow_fetch(fetches_, aborted_);
+    auto first = flights_->join("Python", fetch);
+    auto second = flights_->join(" python ", fetch);
+
+    auto results = first->wait();
+    ASSERT_TRUE(bool(results));
+    EXPECT_EQ("calc", results->answer.type);
+    EXPECT_EQ(results, second->wait());
+    EXPECT_EQ(1, fetches_);
+
+    // Once it's over, the next caller starts a new one
+    flights_->join("python", fetch)->wait();
+    EXPECT_EQ(2, fetches_);
+}
+
+TEST_F(TestSingleFlight, fetch_goes_on_while_someone_waits) {
+    auto fetch = slow_fetch(fetches_, aborted_);
+    auto first = flights_->join("python", fetch);
+    auto second = flights_->join("python", fetch);
+
+    first->cancel();
+    EXPECT_FALSE(first->wait());
+    ASSERT_TRUE(bool(second->wait()));
+    EXPECT_EQ(0, aborted_);
+}
+
+TEST_F(TestSingleFlight, fetch_is_aborted_when_nobody_waits) {
+    auto fetch = slow_fetch(fetches_, aborted_);
+    auto waiter = flights_->join("python", fetch);
+
+    thread canceller([&waiter]() {
+        this_thread::sleep_for(chrono::milliseconds(20));
+        waiter->cancel();
+    });
+    EXPECT_FALSE(waiter->wait());
+    canceller.join();
+
+    // The aborted flight isn't joined, a new one starts
+    auto again = flights_->join("python", fetch);
+    ASSERT_TRUE(bool(again->wait()));
+    EXPECT_EQ(2, fetches_);
+    EXPECT_EQ(1, aborted_);
+}
+
+TEST_F(TestSingleFlight, errors_reach_every_waiter) {
+    auto fetch = [](Client &, const Client::Partial &) -> SingleFlight::Results {
+        this_thread::sleep_for(chrono::milliseconds(20));
+        throw domain_error("boom");
+    };
+    auto first = flights_->join("python", fetch);
+    auto second = flights_->join("python", fetch);
+
+    EXPECT_THROW(first->wait(), domain_error);
+    EXPECT_THROW(second->wait(), domain_error);
+}
+
+TEST_F(TestSingleFlight, partial_results) {
+    auto fetch = [](Client &, const Client::Partial &partial) {
+        Client::QueryResults first;
+        first.answer.type = "first";
+        partial(first);
+        this_thread::sleep_for(chrono::milliseconds(20));
+
+        auto results = make_shared<Client::QueryResults>();
+        results->answer.type = "calc";
+        return SingleFlight::Results(results);
+    };
+
+    string shown;
+    auto results = flights_->join("python", fetch)->wait(
+            [&shown](const Client::QueryResults &partial) {
+        shown = partial.answer.type.to_string();
+    });
+    EXPECT_EQ("first", shown);
+    EXPECT_EQ("calc", results->answer.type);
+}
+
+TEST_F(TestSingleFlight, stop_aborts_and_joins_the_flights) {
+    auto fetch = slow_fetch(fetches_, aborted_);
+    auto waiter = flights_->join("python", fetch);
+    while (fetches_ == 0) {
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+
+    // Once stop returns, no fetch is running anymore
+    auto started = chrono::steady_clock::now();
+    flights_->stop();
+    EXPECT_LT(chrono::steady_clock::now() - started, chrono::milliseconds(200));
+    EXPECT_EQ(1, aborted_);
+
+    // And nothing starts anymore
+    EXPECT_FALSE(flights_->join("ferrara", fetch)->wait());
+    EXPECT_EQ(1, fetches_);
+}
+
+} // namespace
@@ -0,0 +1,229 @@
+#include <api/metrics.h>
+#include <scope/prefetcher.h>
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+using namespace std;
+using namespace api;
+using namespace scope;
+
+/**
+ * Keep the tests in an anonymous namespace
+ */
+namespace {
+
+/**
+ * Fetches which never go to the network: they wait until released, or
+ * until their flight is aborted
+ */
+class FakePrefetcher: public Prefetcher {
+public:
+    FakePrefetcher(Config::Ptr config, SingleFlight::Ptr flights,
+                   Scheduler::Ptr scheduler, ResultCache::Ptr cache) :
+        Prefetcher(config, flights, scheduler, cache), fetches(0), aborted(0),
+        released_(false) {
+    }
+
+    ~FakePrefetcher() {
+        // The workers call our fetch, stop them while we are still whole
+        release();
+        stop();
+    }
+
+    deque<string> queued() {
+        lock_guard<mutex> lock(mutex_);
+        return queue_;
+    }
+
+    void release() {
+        {
+            lock_guard<mutex> lock(fetch_mutex_);
+            released_ = true;
+        }
+        fetch_changed_.notify_all();
+    }
+
+    atomic<int> fetches;
+
+    atomic<int> aborted;
+
+protected:
+    Client::QueryResults fetch(Client &client, const string &) override {
+        ++fetches;
+        unique_lock<mutex> lock(fetch_mutex_);
+        while (!released_ && !client.cancelled()) {
+            fetch_changed_.wait_for(lock, chrono::milliseconds(5));
+        }
+
+        Client::QueryResults results;
+        if (client.cancelled()) {
+            ++aborted;
+            return results;
+        }
+        results.answer.type = "calc";
+        results.answer.instantAnswer = "42";
+        return results;
+    }
+
+    mutex fetch_mutex_;
+
+    condition_variable fetch_changed_;
+
+    bool released_;
+};
+
+class TestPrefetcher: public ::testing::Test {
+protected:
+    void SetUp() override {
+        config_ = make_shared<Config>();
+        config_->prefetch_idle = chrono::milliseconds(10);
+        config_->prefetch_concurrency = 1;
+        flights_ = make_shared<SingleFlight>(config_, HttpPool::Ptr());
+        scheduler_ = make_shared<Scheduler>(config_);
+        cache_ = make_shared<ResultCache>(config_);
+    }
+
+    shared_ptr<FakePrefetcher> prefetcher() {
+        return make_shared<FakePrefetcher>(config_, flights_, scheduler_,
+                                           cache_);
+    }
+
+    /**
+     * Wait up to a second for a condition
+     */
+    template<typename F>
+    bool eventually(F f) {
+        for (int i = 0; i < 200 && !f(); ++i) {
+            this_thread::sleep_for(chrono::milliseconds(5));
+        }
+        return f();
+    }
+
+    Config::Ptr config_;
+
+    SingleFlight::Ptr flights_;
+
+    Scheduler::Ptr scheduler_;
+
+    ResultCache::Ptr cache_;
+};
+
+TEST_F(TestPrefetcher, queue_is_bounded) {
+    config_->prefetch_queue = 3;
+    cache_->put("cached", make_shared<const Client::QueryResults>());
+    auto p = prefetcher();
+
+    // Cached, empty and duplicate queries are skipped
+    p->queue({ "a", "cached", "", "b", "a" });
+    EXPECT_EQ(deque<string>({ "a", "b" }), p->queued());
+
+    // The oldest are dropped for the latest
+    p->queue({ "c", "d", "e" });
+    EXPECT_EQ(deque<string>({ "c", "d", "e" }), p->queued());
+}
+
+TEST_F(TestPrefetcher, fetches_into_the_cache) {
+    auto p = prefetcher();
+    p->start();
+    p->release();
+    p->queue({ "python" });
+
+    EXPECT_TRUE(eventually([this]() {
+        return bool(cache_->get("python"));
+    }));
+    EXPECT_EQ(1, p->fetches);
+}
+
+TEST_F(TestPrefetcher, waits_for_the_searches) {
+    auto p = prefetcher();
+    p->start();
+    p->release();
+
+    // Nothing starts while a search is in flight
+    uint64_t id = scheduler_->admit("session", []() {});
+    p->queue({ "python" });
+    this_thread::sleep_for(chrono::milliseconds(100));
+    EXPECT_EQ(0, p->fetches);
+
+    scheduler_->finish("session", id);
+    EXPECT_TRUE(eventually([this]() {
+        return bool(cache_->get("python"));
+    }));
+}
+
+TEST_F(TestPrefetcher, yields_to_a_search) {
+    uint64_t aborts = Metrics::instance().prefetch_aborts;
+    auto p = prefetcher();
+    p->start();
+    p->queue({ "python" });
+    ASSERT_TRUE(eventually([&p]() {
+        return p->fetches == 1;
+    }));
+
+    // A search for something else aborts the prefetch, only once
+    p->yield("ferrara");
+    p->yield("ferrara");
+    EXPECT_TRUE(eventually([&p]() {
+        return p->aborted == 1;
+    }));
+    EXPECT_EQ(aborts + 1, Metrics::instance().prefetch_aborts);
+    EXPECT_FALSE(cache_->get("python"));
+}
+
+TEST_F(TestPrefetcher, search_for_the_same_query_shares_the_prefetch) {
+    uint64_t aborts = Metrics::instance().prefetch_aborts;
+    auto p = prefetcher();
+    p->start();
+    p->queue({ "python" });
+    ASSERT_TRUE(eventually([&p]() {
+        return p->fetches == 1;
+    }));
+
+    // The tap on the topic joins the flight, then makes way for itself
+    atomic<int> own_fetches(0);
+    auto waiter = flights_->join("Python",
+            [&own_fetches](Client &, const Client::Partial &) {
+        ++own_fetches;
+        return SingleFlight::Results();
+    });
+    p->yield("Python");
+    p->release();
+
+    SingleFlight::Results results = waiter->wait();
+    ASSERT_TRUE(bool(results));
+    EXPECT_EQ("42", results->answer.instantAnswer);
+    EXPECT_EQ(0, own_fetches);
+    EXPECT_EQ(0, p->aborted);
+    EXPECT_EQ(aborts, Metrics::instance().prefetch_aborts);
+}
+
+TEST_F(TestPrefetcher, stop_aborts_the_prefetches) {
+    auto p = prefetcher();
+    p->start();
+    p->queue({ "python", "ferrara" });
+    ASSERT_TRUE(eventually([&p]() {
+        return p->fetches == 1;
+    }));
+
+    // The running fetch is aborted, and the queue dropped
+    auto started = chrono::steady_clock::now();
+    p->stop();
+    EXPECT_LT(chrono::steady_clock::now() - started, chrono::milliseconds(500));
+    EXPECT_TRUE(eventually([&p]() {
+        return p->aborted == 1;
+    }));
+    EXPECT_TRUE(p->queued().empty());
+
+    // And nothing is queued anymore
+    p->queue({ "italy" });
+    EXPECT_TRUE(p->queued().empty());
+}
+
+} // namespace
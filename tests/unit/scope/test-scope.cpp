@@ -1,8 +1,10 @@
+#include <scope/query.h>
 #include <scope/scope.h>
 
 #include <core/posix/exec.h>
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
+#include <chrono>
 #include <string>
 #include <unity/scopes/SearchReply.h>
 #include <unity/scopes/SearchReplyProxyFwd.h>
@@ -49,7 +51,7 @@ class TestScope: public TypedScopeFixtureScope {
 protected:
     void SetUp() override
     {
-        // Start up Python-based fake OpenWeatherMap server
+        // Start up Python-based fake DuckDuckGo server
         fake_server_ = posix::exec("/usr/bin/python3", { FAKE_SERVER }, { },
                                    posix::StandardStream::stdout);
 
@@ -77,65 +79,76 @@ protected:
     posix::ChildProcess fake_server_ = posix::ChildProcess::invalid();
 };
 
+/**
+ * Accept every category and every result, so the tests only need to
+ * expect what they check
+ */
+void accept_all(sct::MockSearchReply &reply, const sc::CategoryRenderer &renderer) {
+    ON_CALL(reply, register_category(_, _, _, _)).WillByDefault(Invoke(
+            [&renderer](const string &id, const string &title,
+                        const string &icon, const sc::CategoryRenderer &) {
+        return make_shared<sct::Category>(id, title, icon, renderer);
+    }));
+    ON_CALL(reply, push(Matcher<sc::CategorisedResult const&>(_)))
+            .WillByDefault(Return(true));
+}
+
 TEST_F(TestScope, empty_search_string) {
     const sc::CategoryRenderer renderer;
     NiceMock<sct::MockSearchReply> reply;
+    accept_all(reply, renderer);
 
     // Build a query with an empty search string
     sc::CannedQuery query(SCOPE_NAME, "", "");
 
-    // Expect the current weather category
-    EXPECT_CALL(reply, register_category("current", "London, GB", "", _)).Times(1)
-            .WillOnce(Return(make_shared<sct::Category>("current", "London, GB", "", renderer)));
+    // The homepage is loaded in background, but the credits are always there
+    EXPECT_CALL(reply, register_category("footer", _, "", _)).Times(1)
+            .WillOnce(Return(make_shared<sct::Category>("footer", "", "", renderer)));
 
-    // With one result
     EXPECT_CALL(reply, push(Matcher<sc::CategorisedResult const&>(AllOf(
-                                                                      ResultProp("title", "21.8°C"),
-                                                                      ResultProp("art", "http://openweathermap.org/img/w/02d.png"),
-                                                                      ResultProp("subtitle", "few clouds")
+                                                                      ResultProp("title", "Discerning Duck 0.1.2"),
+                                                                      ResultProp("summary", "Results from DuckDuckGo")
                                                                       )))).WillOnce(
                 Return(true));
 
-    // Expect the forecast category
-    EXPECT_CALL(reply, register_category("forecast", "7 day forecast", "", _)).Times(1)
-            .WillOnce(Return(make_shared<sct::Category>("forecast", "7 day forecast", "", renderer)));
+    sc::SearchReplyProxy reply_proxy(&reply, [](sc::SearchReply*) {}); // note: this is a std::shared_ptr with empty deleter
+    sc::SearchMetadata meta_data("en_EN", "phone");
 
-    // With seven results
-    EXPECT_CALL(reply, push(Matcher<sc::CategorisedResult const&>(AllOf(
-                                                                      ResultProp("title", "25.1°C to 18.8°C"),
-                                                                      ResultProp("art", "http://openweathermap.org/img/w/10d.png"),
-                                                                      ResultProp("subtitle", "light rain")
-                                                                      )))).WillOnce(Return(true));
-    EXPECT_CALL(reply, push(Matcher<sc::CategorisedResult const&>(AllOf(
-                                                                      ResultProp("title", "20.9°C to 15.5°C"),
-                                                                      ResultProp("art", "http://openweathermap.org/img/w/10d.png"),
-                                                                      ResultProp("subtitle", "moderate rain")
-                                                                      )))).WillOnce(Return(true));
-    EXPECT_CALL(reply, push(Matcher<sc::CategorisedResult const&>(AllOf(
-                                                                      ResultProp("title", "19.6°C to 13.2°C"),
-                                                                      ResultProp("art", "http://openweathermap.org/img/w/03d.png"),
-                                                                      ResultProp("subtitle", "scattered clouds")
-                                                                      )))).WillOnce(Return(true));
-    EXPECT_CALL(reply, push(Matcher<sc::CategorisedResult const&>(AllOf(
-                                                                      ResultProp("title", "18.1°C to 13.5°C"),
-                                                                      ResultProp("art", "http://openweathermap.org/img/w/10d.png"),
-                                                                      ResultProp("subtitle", "moderate rain")
-                                                                      )))).WillOnce(Return(true));
-    EXPECT_CALL(reply, push(Matcher<sc::CategorisedResult const&>(AllOf(
-                                                                      ResultProp("title", "17.4°C to 15.4°C"),
-                                                                      ResultProp("art", "http://openweathermap.org/img/w/10d.png"),
-                                                                      ResultProp("subtitle", "heavy intensity rain")
-                                                                      )))).WillOnce(Return(true));
-    EXPECT_CALL(reply, push(Matcher<sc::CategorisedResult const&>(AllOf(
-                                                                      ResultProp("title", "18.4°C to 16.2°C"),
-                                                                      ResultProp("art", "http://openweathermap.org/img/w/10d.png"),
-                                                                      ResultProp("subtitle", "moderate rain")
-                                                                      )))).WillOnce(Return(true));
+    // Create a query object
+    auto search_query = scope->search(query, meta_data);
+    ASSERT_NE(nullptr, search_query);
+
+    // Run the search
+    search_query->run(reply_proxy);
+
+    // Google Mock will make assertions when the mocks are destructed.
+}
+
+TEST_F(TestScope, search_answer) {
+    const sc::CategoryRenderer renderer;
+    NiceMock<sct::MockSearchReply> reply;
+    accept_all(reply, renderer);
+
+    // Only the ?q= form of this query has the answer
+    sc::CannedQuery query(SCOPE_NAME, "3 * 2", "");
+
+    // Expect the answer category
+    EXPECT_CALL(reply, register_category("answer", "", "", _)).Times(1)
+            .WillOnce(Return(make_shared<sct::Category>("answer", "", "", renderer)));
+
+    // With one result
     EXPECT_CALL(reply, push(Matcher<sc::CategorisedResult const&>(AllOf(
-                                                                      ResultProp("title", "19°C to 16.7°C"),
-                                                                      ResultProp("art", "http://openweathermap.org/img/w/10d.png"),
-                                                                      ResultProp("subtitle", "light rain")
-                                                                      )))).WillOnce(Return(true));
+                                                                      ResultProp("title", "calc"),
+                                                                      ResultProp("summary", "3 * 2 = 6"),
+                                                                      ResultProp("type", "E")
+                                                                      )))).WillOnce(
+                Return(true));
+
+    // Then the credits
+    EXPECT_CALL(reply, push(Matcher<sc::CategorisedResult const&>(
+                                                                      ResultProp("title", "Discerning Duck 0.1.2")
+                                                                      ))).WillOnce(
+                Return(true));
 
     sc::SearchReplyProxy reply_proxy(&reply, [](sc::SearchReply*) {}); // note: this is a std::shared_ptr with empty deleter
     sc::SearchMetadata meta_data("en_EN", "phone");
@@ -150,65 +163,60 @@ TEST_F(TestScope, empty_search_string) {
     // Google Mock will make assertions when the mocks are destructed.
 }
 
-TEST_F(TestScope, search) {
+TEST_F(TestScope, search_disambiguation) {
     const sc::CategoryRenderer renderer;
     NiceMock<sct::MockSearchReply> reply;
+    accept_all(reply, renderer);
 
     // Build a query with a non-empty search string
-    sc::CannedQuery query(SCOPE_NAME, "Manchester,uk", "");
+    sc::CannedQuery query(SCOPE_NAME, "python", "");
 
-    // Expect the current weather category
-    EXPECT_CALL(reply, register_category("current", "Manchester, GB", "", _)).Times(1)
-            .WillOnce(Return(make_shared<sct::Category>("current", "Manchester, GB", "", renderer)));
+    // Expect the disambiguation category
+    EXPECT_CALL(reply, register_category("disambiguation", "Meanings", "", _)).Times(1)
+            .WillOnce(Return(make_shared<sct::Category>("disambiguation", "Meanings", "", renderer)));
 
-    // With one result
+    // With a result for each meaning, the title taken from its link
     EXPECT_CALL(reply, push(Matcher<sc::CategorisedResult const&>(AllOf(
-                                                                      ResultProp("title", "17.4°C"),
-                                                                      ResultProp("art", "http://openweathermap.org/img/w/03d.png"),
-                                                                      ResultProp("subtitle", "scattered clouds")
+                                                                      ResultProp("title", "Python (programming language)"),
+                                                                      ResultProp("summary", "A general-purpose, high-level programming language."),
+                                                                      ResultProp("subtitle", "Source: Wikipedia"),
+                                                                      ResultProp("type", "D")
                                                                       )))).WillOnce(
                 Return(true));
 
-    // Expect the forecast category
-    EXPECT_CALL(reply, register_category("forecast", "7 day forecast", "", _)).Times(1)
-            .WillOnce(Return(make_shared<sct::Category>("forecast", "7 day forecast", "", renderer)));
+    sc::SearchReplyProxy reply_proxy(&reply, [](sc::SearchReply*) {}); // note: this is a std::shared_ptr with empty deleter
+    sc::SearchMetadata meta_data("en_EN", "phone");
 
-    // With seven results
-    EXPECT_CALL(reply, push(Matcher<sc::CategorisedResult const&>(AllOf(
-                                                                      ResultProp("title", "18.8°C to 12°C"),
-                                                                      ResultProp("art", "http://openweathermap.org/img/w/01d.png"),
-                                                                      ResultProp("subtitle", "sky is clear")
-                                                                      )))).WillOnce(Return(true));
-    EXPECT_CALL(reply, push(Matcher<sc::CategorisedResult const&>(AllOf(
-                                                                      ResultProp("title", "18.6°C to 12.3°C"),
-                                                                      ResultProp("art", "http://openweathermap.org/img/w/10d.png"),
-                                                                      ResultProp("subtitle", "moderate rain")
-                                                                      )))).WillOnce(Return(true));
-    EXPECT_CALL(reply, push(Matcher<sc::CategorisedResult const&>(AllOf(
-                                                                      ResultProp("title", "17.1°C to 10.8°C"),
-                                                                      ResultProp("art", "http://openweathermap.org/img/w/04d.png"),
-                                                                      ResultProp("subtitle", "broken clouds")
-                                                                      )))).WillOnce(Return(true));
-    EXPECT_CALL(reply, push(Matcher<sc::CategorisedResult const&>(AllOf(
-                                                                      ResultProp("title", "16°C to 12.2°C"),
-                                                                      ResultProp("art", "http://openweathermap.org/img/w/10d.png"),
-                                                                      ResultProp("subtitle", "moderate rain")
-                                                                      )))).WillOnce(Return(true));
-    EXPECT_CALL(reply, push(Matcher<sc::CategorisedResult const&>(AllOf(
-                                                                      ResultProp("title", "15.7°C to 13°C"),
-                                                                      ResultProp("art", "http://openweathermap.org/img/w/10d.png"),
-                                                                      ResultProp("subtitle", "light rain")
-                                                                      )))).WillOnce(Return(true));
-    EXPECT_CALL(reply, push(Matcher<sc::CategorisedResult const&>(AllOf(
-                                                                      ResultProp("title", "17.6°C to 14.1°C"),
-                                                                      ResultProp("art", "http://openweathermap.org/img/w/10d.png"),
-                                                                      ResultProp("subtitle", "moderate rain")
-                                                                      )))).WillOnce(Return(true));
+    // Create a query object
+    auto search_query = scope->search(query, meta_data);
+    ASSERT_NE(nullptr, search_query);
+
+    // Run the search
+    search_query->run(reply_proxy);
+
+    // Google Mock will make assertions when the mocks are destructed.
+}
+
+TEST_F(TestScope, search_capped_on_phone) {
+    const sc::CategoryRenderer renderer;
+    NiceMock<sct::MockSearchReply> reply;
+    accept_all(reply, renderer);
+
+    // This query has hundreds of meanings
+    sc::CannedQuery query(SCOPE_NAME, "meanings", "");
+
+    // Only the first ones fit a phone
+    EXPECT_CALL(reply, push(Matcher<sc::CategorisedResult const&>(
+                                                                      ResultProp("type", "D")
+                                                                      ))).Times(6).WillRepeatedly(
+                Return(true));
+
+    // The others are behind a card
     EXPECT_CALL(reply, push(Matcher<sc::CategorisedResult const&>(AllOf(
-                                                                      ResultProp("title", "15.5°C to 13.4°C"),
-                                                                      ResultProp("art", "http://openweathermap.org/img/w/10d.png"),
-                                                                      ResultProp("subtitle", "moderate rain")
-                                                                      )))).WillOnce(Return(true));
+                                                                      ResultProp("title", "Show all 400"),
+                                                                      ResultProp("summary", "394 more")
+                                                                      )))).WillOnce(
+                Return(true));
 
     sc::SearchReplyProxy reply_proxy(&reply, [](sc::SearchReply*) {}); // note: this is a std::shared_ptr with empty deleter
     sc::SearchMetadata meta_data("en_EN", "phone");
@@ -223,5 +231,124 @@ TEST_F(TestScope, search) {
     // Google Mock will make assertions when the mocks are destructed.
 }
 
+TEST_F(TestScope, search_capped_by_cardinality) {
+    const sc::CategoryRenderer renderer;
+    NiceMock<sct::MockSearchReply> reply;
+    accept_all(reply, renderer);
+
+    sc::CannedQuery query(SCOPE_NAME, "meanings", "");
+
+    // The shell asks for fewer cards than a desktop shows
+    EXPECT_CALL(reply, push(Matcher<sc::CategorisedResult const&>(
+                                                                      ResultProp("type", "D")
+                                                                      ))).Times(3).WillRepeatedly(
+                Return(true));
+
+    EXPECT_CALL(reply, push(Matcher<sc::CategorisedResult const&>(
+                                                                      ResultProp("title", "Show all 400")
+                                                                      ))).WillOnce(
+                Return(true));
+
+    sc::SearchReplyProxy reply_proxy(&reply, [](sc::SearchReply*) {}); // note: this is a std::shared_ptr with empty deleter
+    sc::SearchMetadata meta_data(3, "en_EN", "desktop");
+
+    // Create a query object
+    auto search_query = scope->search(query, meta_data);
+    ASSERT_NE(nullptr, search_query);
+
+    // Run the search
+    search_query->run(reply_proxy);
+
+    // Google Mock will make assertions when the mocks are destructed.
+}
+
+TEST_F(TestScope, search_full_department) {
+    const sc::CategoryRenderer renderer;
+    NiceMock<sct::MockSearchReply> reply;
+    accept_all(reply, renderer);
+
+    // The query of the "show more" card
+    sc::CannedQuery query(SCOPE_NAME, "meanings", Query::FULL);
+
+    // Every meaning is there
+    EXPECT_CALL(reply, push(Matcher<sc::CategorisedResult const&>(
+                                                                      ResultProp("type", "D")
+                                                                      ))).Times(400).WillRepeatedly(
+                Return(true));
+
+    EXPECT_CALL(reply, push(Matcher<sc::CategorisedResult const&>(
+                                                                      ResultProp("title", "Show all 400")
+                                                                      ))).Times(0);
+
+    sc::SearchReplyProxy reply_proxy(&reply, [](sc::SearchReply*) {}); // note: this is a std::shared_ptr with empty deleter
+    sc::SearchMetadata meta_data("en_EN", "phone");
+
+    // Create a query object
+    auto search_query = scope->search(query, meta_data);
+    ASSERT_NE(nullptr, search_query);
+
+    // Run the search
+    search_query->run(reply_proxy);
+
+    // Google Mock will make assertions when the mocks are destructed.
+}
+
+TEST_F(TestScope, cancelled_search_stops_pushing) {
+    const sc::CategoryRenderer renderer;
+    NiceMock<sct::MockSearchReply> reply;
+    accept_all(reply, renderer);
+
+    sc::SearchReplyProxy reply_proxy(&reply, [](sc::SearchReply*) {}); // note: this is a std::shared_ptr with empty deleter
+    sc::SearchMetadata meta_data("en_EN", "phone");
+
+    // Run the search once, so its results are cached
+    sc::CannedQuery query(SCOPE_NAME, "python", "");
+    scope->search(query, meta_data)->run(reply_proxy);
+    Mock::VerifyAndClearExpectations(&reply);
+    accept_all(reply, renderer);
+
+    // A superseded search has the results at hand, but pushes nothing
+    EXPECT_CALL(reply, push(Matcher<sc::CategorisedResult const&>(_))).Times(0);
+
+    auto search_query = scope->search(query, meta_data);
+    ASSERT_NE(nullptr, search_query);
+    search_query->cancelled();
+    search_query->run(reply_proxy);
+
+    // Google Mock will make assertions when the mocks are destructed.
+}
+
+TEST_F(TestScope, short_query_without_session_is_not_held_back) {
+    const sc::CategoryRenderer renderer;
+    NiceMock<sct::MockSearchReply> reply;
+    accept_all(reply, renderer);
+
+    sc::SearchReplyProxy reply_proxy(&reply, [](sc::SearchReply*) {}); // note: this is a std::shared_ptr with empty deleter
+
+    // Without the session-id hint, no later search could supersede it
+    sc::SearchMetadata meta_data("en_EN", "phone");
+    ASSERT_FALSE(meta_data.contains_hint("session-id"));
+
+    // Warm up the connections to the fake server
+    scope->search(sc::CannedQuery(SCOPE_NAME, "python", ""), meta_data)->run(reply_proxy);
+    Mock::VerifyAndClearExpectations(&reply);
+    accept_all(reply, renderer);
+
+    // A prefix shorter than Config::debounce_prefix_length is searched
+    // right away
+    EXPECT_CALL(reply, push(Matcher<sc::CategorisedResult const&>(
+                                                                      ResultProp("title", "Nothing here")
+                                                                      ))).WillOnce(
+                Return(true));
+
+    auto started = chrono::steady_clock::now();
+    auto search_query = scope->search(sc::CannedQuery(SCOPE_NAME, "py", ""), meta_data);
+    ASSERT_NE(nullptr, search_query);
+    search_query->run(reply_proxy);
+    EXPECT_LT(chrono::steady_clock::now() - started, api::Config().debounce);
+
+    // Google Mock will make assertions when the mocks are destructed.
+}
+
 } // namespace
 